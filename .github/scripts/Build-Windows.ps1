@@ -78,6 +78,9 @@ function Build {
         $CmakeArgs += @(
             "-DBoost_DIR=${ProjectRoot}/.deps/boost/stage/lib/cmake/Boost-1.87.0"
             "-DFMT_DIRECTORY=${ProjectRoot}/.deps/fmt"
+            "-DZLIB_ROOT=${ProjectRoot}/.deps/zlib"
+            "-DZLIB_LIBRARY=${ProjectRoot}/.deps/zlib/lib/zlibstatic.lib"
+            "-DNGHTTP2_ROOT=${ProjectRoot}/.deps/nghttp2"
         )
 
         $CmakeBuildArgs += @(
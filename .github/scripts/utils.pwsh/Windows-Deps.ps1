@@ -31,4 +31,37 @@ function Windows-Deps {
     } else {
         Write-Output "Fmt directory exists, skipping download"
     }
+
+    $ZlibDirectory = "$DepsDirectory/zlib"
+    if(-Not (Test-Path -Path $ZlibDirectory)) {
+        Write-Output "Building zlib"
+        $ZlibUrl = "https://github.com/madler/zlib/releases/download/v1.3.1/zlib131.zip"
+        $ZlibZip = "$DepsDirectory/zlib.zip"
+        $ZlibSourceDirectory = "$DepsDirectory/zlib-1.3.1"
+        Invoke-WebRequest -Uri $ZlibUrl -OutFile $ZlibZip
+        Expand-ArchiveExt -Path $ZlibZip -DestinationPath $DepsDirectory
+        Remove-Item -Path $ZlibZip
+        & cmake -S $ZlibSourceDirectory -B "$ZlibSourceDirectory/build" -A x64 "-DCMAKE_INSTALL_PREFIX=$ZlibDirectory" | Out-Default
+        & cmake --build "$ZlibSourceDirectory/build" --config Release --target INSTALL | Out-Default
+        Remove-Item -Recurse -Force -Path $ZlibSourceDirectory
+    } else {
+        Write-Output "Zlib directory exists, skipping build"
+    }
+
+    $Nghttp2Directory = "$DepsDirectory/nghttp2"
+    if(-Not (Test-Path -Path $Nghttp2Directory)) {
+        Write-Output "Building nghttp2"
+        $Nghttp2Url = "https://github.com/nghttp2/nghttp2/releases/download/v1.64.0/nghttp2-1.64.0.tar.gz"
+        $Nghttp2Archive = "$DepsDirectory/nghttp2.tar.gz"
+        $Nghttp2SourceDirectory = "$DepsDirectory/nghttp2-1.64.0"
+        Invoke-WebRequest -Uri $Nghttp2Url -OutFile $Nghttp2Archive
+        Expand-ArchiveExt -Path $Nghttp2Archive -DestinationPath $DepsDirectory
+        Remove-Item -Path $Nghttp2Archive
+        & cmake -S $Nghttp2SourceDirectory -B "$Nghttp2SourceDirectory/build" -A x64 -DENABLE_LIB_ONLY=ON `
+            -DBUILD_SHARED_LIBS=OFF -DBUILD_STATIC_LIBS=ON "-DCMAKE_INSTALL_PREFIX=$Nghttp2Directory" | Out-Default
+        & cmake --build "$Nghttp2SourceDirectory/build" --config Release --target INSTALL | Out-Default
+        Remove-Item -Recurse -Force -Path $Nghttp2SourceDirectory
+    } else {
+        Write-Output "Nghttp2 directory exists, skipping build"
+    }
 }
\ No newline at end of file
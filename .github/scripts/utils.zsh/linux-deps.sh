@@ -18,3 +18,20 @@ if [[ ! -d ./.deps/boost ]]; then
 else
   echo "Boost directory exists, skipping build"
 fi
+
+# The distribution packages of nghttp2 predate the nghttp2_ssize API (1.60.0), so it's built from source.
+if [[ ! -d ./.deps/nghttp2 ]]; then
+  echo "Building nghttp2"
+  mkdir -p .deps/nghttp2-source
+  pushd .deps/nghttp2-source
+  wget --no-verbose -O nghttp2.tar.gz https://github.com/nghttp2/nghttp2/releases/download/v1.64.0/nghttp2-1.64.0.tar.gz
+  tar -xzf nghttp2.tar.gz --strip-components=1
+  rm nghttp2.tar.gz
+  cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DENABLE_LIB_ONLY=ON -DBUILD_SHARED_LIBS=OFF -DBUILD_STATIC_LIBS=ON \
+    -DCMAKE_POSITION_INDEPENDENT_CODE=ON -DCMAKE_INSTALL_PREFIX="$(pwd)/../nghttp2"
+  cmake --build build --target install
+  popd
+  rm -rf .deps/nghttp2-source
+else
+  echo "nghttp2 directory exists, skipping build"
+fi
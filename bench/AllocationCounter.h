@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <cstdint>
+
+/// Counts the heap allocations of the whole process. The benchmarks replace the global operator new to do that.
+class AllocationCounter {
+public:
+    static std::uint64_t get();
+};
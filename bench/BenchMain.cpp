@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include <cstdlib>
+
+#include "Benchmark.h"
+
+int main() {
+    bool passed = true;
+    passed = benchmarkRequestBuilding() && passed;
+    passed = benchmarkRewardsParsing() && passed;
+    passed = benchmarkPubsubDecoding() && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+
+#include "AllocationCounter.h"
+
+/// The allocations and the time per run of an operation, in the steady state.
+struct BenchmarkResult {
+    double allocations;
+    double nanoseconds;
+};
+
+/// Runs the operation once to warm up the caches and the reusable buffers, then measures the given number of runs.
+template <typename Operation>
+BenchmarkResult measure(std::size_t iterations, Operation&& operation) {
+    operation();
+    std::uint64_t allocationsBefore = AllocationCounter::get();
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; i++) {
+        operation();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::uint64_t allocations = AllocationCounter::get() - allocationsBefore;
+    return {
+        static_cast<double>(allocations) / static_cast<double>(iterations),
+        elapsed.count() / static_cast<double>(iterations),
+    };
+}
+
+inline void printResult(std::string_view name, const BenchmarkResult& result) {
+    fmt::print("{:<48} {:>8.1f} allocations {:>12.0f} ns\n", name, result.allocations, result.nanoseconds);
+}
+
+/// Each benchmark prints its results and returns false if a check of the expected allocation count has failed.
+bool benchmarkRequestBuilding();
+bool benchmarkRewardsParsing();
+bool benchmarkPubsubDecoding();
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+
+#include "Benchmark.h"
+#include "PubsubMessageDecoder.h"
+
+static const std::size_t ITERATIONS = 100000;
+
+static std::string readRedemptionMessage() {
+    // A reward-redeemed message of the channel-points-channel-v1 topic, as received from PubSub.
+    std::ifstream file(BENCH_DATA_DIRECTORY "/pubsub-redemption.json", std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool benchmarkPubsubDecoding() {
+    std::string message = readRedemptionMessage();
+    if (message.empty()) {
+        fmt::print("Couldn't read {}/pubsub-redemption.json\n", BENCH_DATA_DIRECTORY);
+        return false;
+    }
+    PubsubMessageDecoder decoder;
+    std::optional<RewardRedemption> redemption = decoder.decodeRedemption(decoder.decodeMessage(message).data);
+    if (!redemption) {
+        fmt::print("The message hasn't been decoded as a redemption\n");
+        return false;
+    }
+    std::size_t redemptionCount = 0;
+
+    BenchmarkResult messageResult = measure(ITERATIONS, [&] {
+        redemptionCount += decoder.decodeMessage(message).data.empty() ? 0 : 1;
+    });
+    BenchmarkResult redemptionResult = measure(ITERATIONS, [&] {
+        PubsubMessageDecoder::Message decodedMessage = decoder.decodeMessage(message);
+        redemptionCount += decoder.decodeRedemption(decodedMessage.data).has_value() ? 1 : 0;
+    });
+    // Building the RewardRedemption allocates as much as copying it, plus the temporary url that the image URL is
+    // converted to for the Reward constructor.
+    BenchmarkResult copyResult = measure(ITERATIONS, [&] {
+        RewardRedemption redemptionCopy = redemption.value();
+        redemptionCount += redemptionCopy.redemptionId.empty() ? 0 : 1;
+    });
+    printResult("Decoding a PubSub message", messageResult);
+    printResult("Decoding a PubSub redemption message", redemptionResult);
+    printResult("Copying a RewardRedemption", copyResult);
+
+    // Once the buffers of the decoder have grown, decoding itself mustn't allocate.
+    bool passed = true;
+    if (messageResult.allocations > 0) {
+        fmt::print("Expected decoding a message not to allocate\n");
+        passed = false;
+    }
+    if (redemptionResult.allocations > copyResult.allocations + 1) {
+        fmt::print("Expected decoding a redemption to allocate only the RewardRedemption\n");
+        passed = false;
+    }
+    return passed && redemptionCount > 0;
+}
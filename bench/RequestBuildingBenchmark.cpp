@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include <string>
+
+#include "Benchmark.h"
+#include "HttpClient.h"
+#include "HttpEndpoint.h"
+#include "HttpHeaderBuilder.h"
+
+namespace http = boost::beast::http;
+
+static constexpr HttpEndpoint GET_REWARDS_ENDPOINT(
+    "api.twitch.tv",
+    "/helix/channel_points/custom_rewards",
+    http::verb::get,
+    {http::status::ok, http::status::forbidden}
+);
+static const std::size_t ITERATIONS = 100000;
+// Beast allocates the start line and each of the host, Authorization and Client-Id fields separately.
+static const double EXPECTED_ALLOCATIONS = 4;
+
+bool benchmarkRequestBuilding() {
+    // Twitch access tokens and client ids are 30 characters long.
+    const std::string accessToken(30, 'a');
+    const std::string clientId(30, 'c');
+    std::size_t targetSizes = 0;
+
+    BenchmarkResult result = measure(ITERATIONS, [&] {
+        // The same fields as TwitchAuth::addAuthorizationHeaders() adds.
+        HttpHeaderBuilder headers;
+        headers.add("Authorization", "Bearer ", accessToken);
+        headers.add("Client-Id", clientId);
+        http::request<http::string_body> request = HttpClient::buildRequest(
+            GET_REWARDS_ENDPOINT, headers, {{"broadcaster_id", "123456789"}, {"only_manageable_rewards", "true"}}, {}
+        );
+        targetSizes += request.target().size();
+    });
+    printResult("Building a Helix request", result);
+
+    if (targetSizes == 0 || result.allocations > EXPECTED_ALLOCATIONS) {
+        fmt::print("Expected at most {} allocations per request\n", EXPECTED_ALLOCATIONS);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include <boost/json.hpp>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Benchmark.h"
+#include "HttpClient.h"
+#include "TwitchRewardsApi.h"
+
+namespace json = boost::json;
+
+static const std::size_t ITERATIONS = 1000;
+// ResponseStream::readChunk() passes the body on in chunks of up to this size.
+static const std::size_t CHUNK_SIZE = 16384;
+
+static std::string readRewardsPayload() {
+    // A Get Custom Reward response with 20 rewards.
+    std::ifstream file(BENCH_DATA_DIRECTORY "/rewards.json", std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// What HttpClient::request<T>() does: the chunks are fed to a parser that allocates from a per-request arena,
+// and the rewards are converted right out of it.
+static std::vector<Reward> parseStreaming(std::string_view payload) {
+    HttpClient::TypedResponseArenaBuffer arenaBuffer;
+    json::monotonic_resource arena(arenaBuffer.data(), arenaBuffer.size());
+    json::storage_ptr storage = &arena;
+    json::stream_parser parser(storage);
+    parser.reset(storage);
+    for (std::size_t offset = 0; offset < payload.size(); offset += CHUNK_SIZE) {
+        std::string_view chunk = payload.substr(offset, CHUNK_SIZE);
+        parser.write(chunk.data(), chunk.size());
+    }
+    parser.finish();
+    json::value responseJson = parser.release();
+    return json::value_to<HelixData<Reward>>(responseJson).data;
+}
+
+// What HttpClient::request() did before: the body is copied into a string, parsed into a tree on the heap,
+// and the rewards are copied out of the tree.
+static std::vector<Reward> parseWhole(std::string_view payload) {
+    std::string body(payload);
+    json::value responseJson = json::parse(body);
+    return json::value_to<std::vector<Reward>>(responseJson.at("data"));
+}
+
+bool benchmarkRewardsParsing() {
+    std::string payload = readRewardsPayload();
+    if (payload.empty()) {
+        fmt::print("Couldn't read {}/rewards.json\n", BENCH_DATA_DIRECTORY);
+        return false;
+    }
+    // Building the rewards allocates the same in both cases, so it's measured separately.
+    std::vector<Reward> rewards = parseWhole(payload);
+    std::size_t rewardCount = 0;
+
+    BenchmarkResult rewardsResult = measure(ITERATIONS, [&] {
+        std::vector<Reward> rewardsCopy = rewards;
+        rewardCount += rewardsCopy.size();
+    });
+    BenchmarkResult streamingResult = measure(ITERATIONS, [&] {
+        rewardCount += parseStreaming(payload).size();
+    });
+    BenchmarkResult wholeResult = measure(ITERATIONS, [&] {
+        rewardCount += parseWhole(payload).size();
+    });
+    printResult(fmt::format("Copying {} rewards", rewards.size()), rewardsResult);
+    printResult("Parsing the rewards with request<T>()", streamingResult);
+    printResult("Parsing the rewards with json::parse()", wholeResult);
+
+    if (rewardCount == 0 || streamingResult.allocations >= wholeResult.allocations) {
+        fmt::print("Expected request<T>() to allocate less than json::parse()\n");
+        return false;
+    }
+    return true;
+}
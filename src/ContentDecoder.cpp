@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "ContentDecoder.h"
+
+#include <fmt/core.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+// zlib window bits. Adding 16 makes zlib expect the gzip wrapper instead of the zlib one.
+static const int MAX_WINDOW_BITS = 15;
+static const int GZIP_WINDOW_BITS = MAX_WINDOW_BITS + 16;
+
+std::optional<ContentDecoder::Encoding> ContentDecoder::parseEncoding(std::string_view contentEncoding) {
+    if (boost::algorithm::iequals(contentEncoding, "gzip") || boost::algorithm::iequals(contentEncoding, "x-gzip")) {
+        return Encoding::GZIP;
+    }
+    if (boost::algorithm::iequals(contentEncoding, "deflate")) {
+        return Encoding::DEFLATE;
+    }
+    return {};
+}
+
+ContentDecoder::ContentDecoder(Encoding encoding) : stream{}, outputFull(false), done(false) {
+    // "deflate" is the zlib format according to RFC 9110.
+    int windowBits = encoding == Encoding::GZIP ? GZIP_WINDOW_BITS : MAX_WINDOW_BITS;
+    if (inflateInit2(&stream, windowBits) != Z_OK) {
+        throw DecodingException("Failed to initialize zlib");
+    }
+}
+
+ContentDecoder::~ContentDecoder() {
+    inflateEnd(&stream);
+}
+
+void ContentDecoder::setInput(std::string_view input) {
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+}
+
+std::string_view ContentDecoder::decode() {
+    // zlib may keep a part of the decoded data if the output buffer has been filled up.
+    if (done || (stream.avail_in == 0 && !outputFull)) {
+        return {};
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+    int result = inflate(&stream, Z_NO_FLUSH);
+    switch (result) {
+    case Z_OK: break;
+    // No progress is possible, as the input ends in the middle of a deflate block.
+    case Z_BUF_ERROR: break;
+    case Z_STREAM_END:
+        done = true;
+        // Ignore anything after the end of the compressed stream.
+        stream.avail_in = 0;
+        break;
+    default: throw DecodingException(fmt::format("inflate failed: {}", stream.msg ? stream.msg : "unknown error"));
+    }
+    outputFull = stream.avail_out == 0;
+    return std::string_view(output.data(), output.size() - stream.avail_out);
+}
+
+bool ContentDecoder::isDone() const {
+    return done;
+}
+
+ContentDecoder::DecodingException::DecodingException(const std::string& message)
+    : message(fmt::format("DecodingException: {}", message)) {}
+
+const char* ContentDecoder::DecodingException::what() const noexcept {
+    return message.c_str();
+}
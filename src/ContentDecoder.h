@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <zlib.h>
+
+#include <array>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Incrementally decodes an HTTP body compressed with gzip or deflate, one chunk of the encoded body at a time.
+class ContentDecoder {
+public:
+    enum class Encoding {
+        GZIP,
+        DEFLATE,
+    };
+
+    /// Returns an empty optional for the identity encoding and for the encodings that aren't supported.
+    static std::optional<Encoding> parseEncoding(std::string_view contentEncoding);
+
+    ContentDecoder(Encoding encoding);
+    ContentDecoder(const ContentDecoder&) = delete;
+    ContentDecoder& operator=(const ContentDecoder&) = delete;
+    ~ContentDecoder();
+
+    /// Feeds the next chunk of the encoded body. The chunk has to stay valid until decode() returns an empty view.
+    void setInput(std::string_view input);
+
+    /// Decodes the next part of the input. Returns an empty view once the input has been consumed.
+    /// The view is valid until the next call.
+    std::string_view decode();
+
+    /// Whether the end of the compressed stream has been reached.
+    bool isDone() const;
+
+    class DecodingException : public std::exception {
+    public:
+        DecodingException(const std::string& message);
+        const char* what() const noexcept override;
+
+    private:
+        std::string message;
+    };
+
+private:
+    z_stream stream;
+    std::array<char, 16384> output;
+    bool outputFull;
+    bool done;
+};
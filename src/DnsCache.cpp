@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "DnsCache.h"
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "Log.h"
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using namespace std::chrono_literals;
+
+static const auto MIN_TTL = 10s;
+
+DnsCache::DnsCache(asio::io_context& ioContext, std::chrono::steady_clock::duration ttl)
+    : ioContext(ioContext), ttl(std::max<std::chrono::steady_clock::duration>(ttl, MIN_TTL)) {
+    asio::co_spawn(ioContext, asyncRefreshPeriodically(), asio::detached);
+}
+
+DnsCache::~DnsCache() = default;
+
+asio::awaitable<DnsCache::Results> DnsCache::resolve(const std::string& host, const std::string& service) {
+    Key key{host, service};
+    std::optional<Entry> cachedEntry;
+    {
+        std::lock_guard guard(entriesMutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            cachedEntry = it->second;
+        }
+    }
+    if (cachedEntry && std::chrono::steady_clock::now() - cachedEntry->resolvedAt < ttl) {
+        co_return cachedEntry->results;
+    }
+
+    Results results;
+    bool resolveFailed = false;
+    try {
+        results = co_await asyncResolve(host, service);
+    } catch (const boost::system::system_error& error) {
+        if (!cachedEntry) {
+            throw;
+        }
+        log(LOG_WARNING, "Failed to resolve {}, using the last known addresses: {}", host, error.what());
+        resolveFailed = true;
+    }
+
+    if (resolveFailed) {
+        co_return cachedEntry->results;
+    }
+    saveEntry(key, results);
+    co_return results;
+}
+
+void DnsCache::clear() {
+    std::lock_guard guard(entriesMutex);
+    entries.clear();
+}
+
+asio::awaitable<DnsCache::Results> DnsCache::asyncResolve(const std::string& host, const std::string& service) {
+    tcp::resolver resolver{co_await asio::this_coro::executor};
+    co_return co_await resolver.async_resolve(host, service, asio::use_awaitable);
+}
+
+asio::awaitable<void> DnsCache::asyncRefreshPeriodically() {
+    // Entries older than half of the ttl are refreshed, so that they're never found expired by resolve().
+    for (;; co_await asio::steady_timer(ioContext, ttl / 4).async_wait(asio::use_awaitable)) {
+        std::vector<Key> keysToRefresh;
+        {
+            std::lock_guard guard(entriesMutex);
+            auto now = std::chrono::steady_clock::now();
+            for (const auto& [key, entry] : entries) {
+                if (now - entry.resolvedAt >= ttl / 2) {
+                    keysToRefresh.push_back(key);
+                }
+            }
+        }
+
+        for (const auto& key : keysToRefresh) {
+            try {
+                saveEntry(key, co_await asyncResolve(key.first, key.second));
+            } catch (const std::exception& exception) {
+                // Keep the old entry, it will be used as a fallback.
+                log(LOG_WARNING, "Failed to refresh the addresses of {}: {}", key.first, exception.what());
+            }
+        }
+    }
+}
+
+void DnsCache::saveEntry(const Key& key, const Results& results) {
+    std::lock_guard guard(entriesMutex);
+    entries[key] = Entry{results, std::chrono::steady_clock::now()};
+}
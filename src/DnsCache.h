@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "BoostAsio.h"
+
+/// Caches resolved addresses for ttl, so that connecting to a host doesn't wait for the resolver every time.
+/// Entries are refreshed in the background before they expire. If the resolver fails, the last known addresses
+/// are used even if they have expired.
+class DnsCache {
+public:
+    using Results = boost::asio::ip::tcp::resolver::results_type;
+
+    DnsCache(boost::asio::io_context& ioContext, std::chrono::steady_clock::duration ttl);
+    ~DnsCache();
+
+    /// Runs on the executor of the calling coroutine.
+    boost::asio::awaitable<Results> resolve(const std::string& host, const std::string& service);
+
+    void clear();
+
+private:
+    using Key = std::pair<std::string, std::string>;
+
+    struct Entry {
+        Results results;
+        std::chrono::steady_clock::time_point resolvedAt;
+    };
+
+    static boost::asio::awaitable<Results> asyncResolve(const std::string& host, const std::string& service);
+    boost::asio::awaitable<void> asyncRefreshPeriodically();
+    void saveEntry(const Key& key, const Results& results);
+
+    boost::asio::io_context& ioContext;
+    const std::chrono::steady_clock::duration ttl;
+    std::map<Key, Entry> entries;
+    std::mutex entriesMutex;
+};
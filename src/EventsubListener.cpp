@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "EventsubListener.h"
+
+#include <fmt/core.h>
+
+#include <utility>
+
+#include "HttpEndpoint.h"
+#include "Log.h"
+#include "TwitchRewardsApi.h"
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace asio = boost::asio;
+namespace ssl = asio::ssl;
+namespace json = boost::json;
+namespace urls = boost::urls;
+
+using namespace boost::asio::experimental::awaitable_operators;
+using namespace std::chrono_literals;
+
+static const char* const EVENTSUB_URL = "wss://eventsub.wss.twitch.tv/ws";
+static const char* const REDEMPTION_SUBSCRIPTION_TYPE = "channel.channel_points_custom_reward_redemption.add";
+// The welcome message is the first message of a connection and is expected to arrive right away.
+static const auto WELCOME_TIMEOUT = 10s;
+// Allow the keepalive messages to be a bit late because of the network.
+static const auto KEEPALIVE_TIMEOUT_MARGIN = 2s;
+// Twitch closes the old connection within 30 seconds after asking to reconnect.
+static const auto OLD_CONNECTION_DRAIN_TIMEOUT = 30s;
+
+// https://dev.twitch.tv/docs/api/reference/#create-eventsub-subscription
+static constexpr HttpEndpoint CREATE_SUBSCRIPTION_ENDPOINT(
+    "api.twitch.tv", "/helix/eventsub/subscriptions", http::verb::post, {http::status::accepted}
+);
+
+EventsubListener::EventsubListener(
+    TwitchAuth& twitchAuth,
+    HttpClient& httpClient,
+    RewardRedemptionQueue& rewardRedemptionQueue,
+    RedemptionReconciler& redemptionReconciler,
+    TlsContext& tlsContext,
+    DnsCache& dnsCache,
+    HappyEyeballsConnector& happyEyeballsConnector,
+    WebsocketCompression& websocketCompression,
+    bool enabled
+)
+    : twitchAuth(twitchAuth), httpClient(httpClient), rewardRedemptionQueue(rewardRedemptionQueue),
+      redemptionReconciler(redemptionReconciler), tlsContext(tlsContext), dnsCache(dnsCache),
+      happyEyeballsConnector(happyEyeballsConnector), websocketCompression(websocketCompression), enabled(enabled),
+      eventsubThread(1),
+      reconnectCondVar(eventsubThread.ioContext, boost::posix_time::pos_infin), reconnectGeneration(0) {
+    connect(&twitchAuth, &TwitchAuth::onUsernameChanged, this, &EventsubListener::reconnectAfterUsernameChange);
+    asio::co_spawn(eventsubThread.ioContext, asyncReconnectToEventsubForever(), asio::detached);
+}
+
+EventsubListener::~EventsubListener() {
+    eventsubThread.stop();
+}
+
+void EventsubListener::setEnabled(bool enabled) {
+    this->enabled = enabled;
+    notifyReconnectCondVar();
+}
+
+void EventsubListener::reconnect() {
+    asio::post(eventsubThread.ioContext, [this] {
+        reconnectGeneration++;
+        reconnectCondVar.cancel();
+    });
+}
+
+void EventsubListener::reconnectAfterUsernameChange() {
+    notifyReconnectCondVar();
+}
+
+const char* EventsubListener::KeepaliveTimeoutException::what() const noexcept {
+    return "KeepaliveTimeoutException";
+}
+
+EventsubListener::UnexpectedMessageException::UnexpectedMessageException(const std::string& messageType)
+    : message(fmt::format("UnexpectedMessageException: {}", messageType)) {}
+
+const char* EventsubListener::UnexpectedMessageException::what() const noexcept {
+    return message.c_str();
+}
+
+void EventsubListener::notifyReconnectCondVar() {
+    asio::post(eventsubThread.ioContext, [this] {
+        reconnectCondVar.cancel();  // Equivalent to notify_all() for a condition variable.
+    });
+}
+
+asio::awaitable<void> EventsubListener::asyncReconnectToEventsubForever() {
+    while (true) {
+        std::optional<std::string> usernameOptional = twitchAuth.getUsername();
+        if (!enabled || !usernameOptional.has_value()) {
+            try {
+                co_await reconnectCondVar.async_wait(asio::use_awaitable);
+            } catch (const boost::system::system_error&) {
+                // Username updated or EventSub enabled.
+            }
+            continue;
+        }
+        std::string username = usernameOptional.value();
+
+        std::uint64_t generation = reconnectGeneration;
+        try {
+            co_await (asyncConnectToEventsub(username) && reconnectCondVar.async_wait(asio::use_awaitable));
+        } catch (const std::exception& e) {
+            log(LOG_ERROR, "Exception in asyncReconnectToEventsubForever: {}", e.what());
+        }
+
+        if (!enabled || twitchAuth.getUsername() != username || reconnectGeneration != generation) {
+            // Disconnected on purpose: because of a username change, because EventSub has been disabled or by
+            // reconnect(). Don't wait.
+            reconnectBackoff.reset();
+            continue;
+        }
+        std::chrono::milliseconds reconnectDelay = reconnectBackoff.onDisconnected();
+        // The wait is cut short by the same events as the connection, e.g. by reconnect() once the network is back.
+        // Unlike the || operator, wait_for_one() also ends the race when the condition variable is cancelled.
+        asio::steady_timer backoffTimer(eventsubThread.ioContext, reconnectDelay);
+        auto race = asio::experimental::make_parallel_group(
+            backoffTimer.async_wait(asio::deferred), reconnectCondVar.async_wait(asio::deferred)
+        );
+        co_await race.async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
+    }
+}
+
+asio::awaitable<void> EventsubListener::asyncConnectToEventsub(const std::string& username) {
+    log(LOG_INFO, "Connecting to EventSub for user {}", username);
+    Connection connection = co_await asyncOpenSession(urls::url_view(EVENTSUB_URL));
+    co_await asyncSubscribeToChannelPoints(connection.session.id);
+    reconnectBackoff.onConnected();
+    RedemptionReconciler::Connection reconcilerConnection(redemptionReconciler);
+
+    while (true) {
+        std::string reconnectUrl = co_await asyncReadMessages(connection);
+        log(LOG_INFO, "Moving the EventSub session to {}", reconnectUrl);
+        // Twitch moves the subscriptions over to the new connection, so they aren't created again. Until the new
+        // connection is welcomed, the events keep arriving over the old one, so it's read in the meantime.
+        asio::co_spawn(eventsubThread.ioContext, asyncDrainConnection(std::move(connection)), asio::detached);
+        connection = co_await asyncOpenSession(urls::parse_uri(reconnectUrl).value());
+    }
+}
+
+asio::awaitable<EventsubListener::Connection> EventsubListener::asyncOpenSession(urls::url_view url) {
+    std::unique_ptr<WebsocketStream> ws = co_await asyncConnect(url);
+    WebsocketCompression::Counter trafficCounter(websocketCompression, ws->next_layer().native_handle());
+    json::value message = co_await asyncReadMessage(*ws, WELCOME_TIMEOUT, trafficCounter);
+    std::string messageType = value_to<std::string>(message.at("metadata").at("message_type"));
+    if (messageType != "session_welcome") {
+        throw UnexpectedMessageException(messageType);
+    }
+    const json::value& session = message.at("payload").at("session");
+    co_return Connection{
+        std::move(ws),
+        Session{
+            value_to<std::string>(session.at("id")),
+            std::chrono::seconds(value_to<std::int64_t>(session.at("keepalive_timeout_seconds"))),
+        },
+        trafficCounter,
+    };
+}
+
+asio::awaitable<std::unique_ptr<EventsubListener::WebsocketStream>> EventsubListener::asyncConnect(
+    urls::url_view url
+) {
+    auto ws = std::make_unique<WebsocketStream>(eventsubThread.ioContext, *tlsContext.get());
+    std::string host = url.host();
+    const auto resolveResults = co_await dnsCache.resolve(host, "https");
+
+    co_await happyEyeballsConnector.connect(get_lowest_layer(*ws), host, resolveResults);
+    WebsocketKeepalive::enable(*ws);
+    tlsContext.prepareHandshake(ws->next_layer().native_handle(), host);
+    co_await ws->next_layer().async_handshake(ssl::stream_base::client, asio::use_awaitable);
+    tlsContext.onHandshakeCompleted(ws->next_layer().native_handle());
+    websocketCompression.enable(*ws);
+    co_await ws->async_handshake(host, url.encoded_target(), asio::use_awaitable);
+    co_return ws;
+}
+
+asio::awaitable<void> EventsubListener::asyncSubscribeToChannelPoints(const std::string& sessionId) {
+    json::value body{
+        {"type", REDEMPTION_SUBSCRIPTION_TYPE},
+        {"version", "1"},
+        {"condition", {{"broadcaster_user_id", twitchAuth.getUserIdOrThrow()}}},
+        {"transport", {{"method", "websocket"}, {"session_id", sessionId}}},
+    };
+    HttpClient::Response response = co_await httpClient.request(CREATE_SUBSCRIPTION_ENDPOINT, twitchAuth, {}, body);
+    if (!CREATE_SUBSCRIPTION_ENDPOINT.isExpectedStatus(response.status)) {
+        throw TwitchRewardsApi::UnexpectedHttpStatusException(response.json);
+    }
+}
+
+asio::awaitable<std::string> EventsubListener::asyncReadMessages(Connection& connection) {
+    while (true) {
+        json::value message = co_await asyncReadMessage(
+            *connection.ws, connection.session.keepaliveTimeout, connection.trafficCounter
+        );
+        if (std::optional<std::string> reconnectUrl = handleMessage(message)) {
+            co_return reconnectUrl.value();
+        }
+    }
+}
+
+asio::awaitable<void> EventsubListener::asyncDrainConnection(Connection connection) {
+    auto drainUntil = std::chrono::steady_clock::now() + OLD_CONNECTION_DRAIN_TIMEOUT;
+    try {
+        while (std::chrono::steady_clock::now() < drainUntil) {
+            handleMessage(co_await asyncReadMessage(
+                *connection.ws, connection.session.keepaliveTimeout, connection.trafficCounter
+            ));
+        }
+    } catch (const std::exception&) {
+        // The old connection has been closed by the server.
+    }
+}
+
+std::optional<std::string> EventsubListener::handleMessage(const json::value& message) {
+    std::string messageType = value_to<std::string>(message.at("metadata").at("message_type"));
+    if (messageType == "session_keepalive") {
+        return {};
+    } else if (messageType == "session_reconnect") {
+        return value_to<std::string>(message.at("payload").at("session").at("reconnect_url"));
+    } else if (messageType == "notification") {
+        const json::value& payload = message.at("payload");
+        if (value_to<std::string>(payload.at("subscription").at("type")) != REDEMPTION_SUBSCRIPTION_TYPE) {
+            return {};
+        }
+        const json::value& event = payload.at("event");
+        Reward reward = TwitchRewardsApi::parseEventsubReward(event.at("reward"));
+        std::string redemptionId = value_to<std::string>(event.at("id"));
+        RedemptionTimestamps timestamps;
+        timestamps.receivedAt = std::chrono::steady_clock::now();
+        timestamps.source = RedemptionSource::EVENTSUB;
+        try {
+            timestamps.redeemedAt = TwitchRewardsApi::parseTimestamp(value_to<std::string>(event.at("redeemed_at")));
+        } catch (const TwitchRewardsApi::InvalidTimestampException&) {
+            // It's only needed for the latency metrics, so the redemption is still played.
+        }
+        rewardRedemptionQueue.queueRewardRedemption(RewardRedemption{reward, redemptionId, timestamps});
+        return {};
+    } else if (messageType == "revocation") {
+        // The subscription is gone, e.g. because the token has been revoked. Reconnecting creates it again.
+        throw UnexpectedMessageException(messageType);
+    }
+    return {};
+}
+
+asio::awaitable<json::value> EventsubListener::asyncReadMessage(
+    WebsocketStream& ws,
+    std::chrono::seconds keepaliveTimeout,
+    WebsocketCompression::Counter& trafficCounter
+) {
+    std::string message;
+    auto buffer = asio::dynamic_buffer(message);
+    asio::steady_timer timer{co_await asio::this_coro::executor, keepaliveTimeout + KEEPALIVE_TIMEOUT_MARGIN};
+    // Unlike the || operator, wait_for_one() ends the race when the read fails, so its error isn't held back until
+    // the keepalive timeout.
+    auto race = asio::experimental::make_parallel_group(
+        ws.async_read(buffer, asio::deferred), timer.async_wait(asio::deferred)
+    );
+    auto [order, readEc, bytesRead, timerEc] =
+        co_await race.async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
+    if (order[0] == 1) {
+        throw KeepaliveTimeoutException();
+    }
+    if (readEc) {
+        throw boost::system::system_error(readEc);
+    }
+    trafficCounter.recordMessage(message.size());
+    co_return json::parse(message);
+}
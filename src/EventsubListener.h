@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+#include <QObject>
+#include <atomic>
+#include <boost/json.hpp>
+#include <boost/url.hpp>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "BoostAsio.h"
+#include "DnsCache.h"
+#include "HappyEyeballsConnector.h"
+#include "HttpClient.h"
+#include "IoThreadPool.h"
+#include "ReconnectBackoff.h"
+#include "RedemptionReconciler.h"
+#include "RewardRedemptionQueue.h"
+#include "TlsContext.h"
+#include "TwitchAuth.h"
+#include "WebsocketCompression.h"
+#include "WebsocketKeepalive.h"
+
+/// Listens to channel points redemptions over an EventSub WebSocket. An alternative to PubsubListener, only one of
+/// them is enabled at a time.
+/// Read https://dev.twitch.tv/docs/eventsub/handling-websocket-events/ for API documentation.
+class EventsubListener : public QObject {
+    Q_OBJECT
+
+public:
+    EventsubListener(
+        TwitchAuth& twitchAuth,
+        HttpClient& httpClient,
+        RewardRedemptionQueue& rewardRedemptionQueue,
+        RedemptionReconciler& redemptionReconciler,
+        TlsContext& tlsContext,
+        DnsCache& dnsCache,
+        HappyEyeballsConnector& happyEyeballsConnector,
+        WebsocketCompression& websocketCompression,
+        bool enabled
+    );
+    ~EventsubListener();
+
+    /// Connects or disconnects. Thread-safe.
+    void setEnabled(bool enabled);
+
+    /// Drops the connection and connects again right away, without the backoff, e.g. when the network has changed.
+    /// Thread-safe.
+    void reconnect();
+
+private slots:
+    void reconnectAfterUsernameChange();
+
+private:
+    using WebsocketStream = boost::beast::websocket::stream<boost::beast::ssl_stream<boost::asio::ip::tcp::socket>>;
+
+    struct Session {
+        std::string id;
+        /// The server sends a message at least this often, otherwise the connection is considered lost.
+        std::chrono::seconds keepaliveTimeout;
+    };
+
+    struct Connection {
+        std::unique_ptr<WebsocketStream> ws;
+        Session session;
+        WebsocketCompression::Counter trafficCounter;
+    };
+
+    class KeepaliveTimeoutException : public std::exception {
+        const char* what() const noexcept override;
+    };
+
+    class UnexpectedMessageException : public std::exception {
+    public:
+        UnexpectedMessageException(const std::string& messageType);
+        const char* what() const noexcept override;
+
+    private:
+        std::string message;
+    };
+
+    void notifyReconnectCondVar();
+    boost::asio::awaitable<void> asyncReconnectToEventsubForever();
+    boost::asio::awaitable<void> asyncConnectToEventsub(const std::string& username);
+    /// Connects and waits for the welcome message.
+    boost::asio::awaitable<Connection> asyncOpenSession(boost::urls::url_view url);
+    boost::asio::awaitable<std::unique_ptr<WebsocketStream>> asyncConnect(boost::urls::url_view url);
+    boost::asio::awaitable<void> asyncSubscribeToChannelPoints(const std::string& sessionId);
+    /// Handles the messages until the server asks to reconnect, returns the URL to reconnect to.
+    boost::asio::awaitable<std::string> asyncReadMessages(Connection& connection);
+    /// Handles the messages that arrive over an old connection while the session is moved to a new one.
+    boost::asio::awaitable<void> asyncDrainConnection(Connection connection);
+    /// Returns the reconnect URL if the message is a session_reconnect one.
+    std::optional<std::string> handleMessage(const boost::json::value& message);
+    static boost::asio::awaitable<boost::json::value> asyncReadMessage(
+        WebsocketStream& ws,
+        std::chrono::seconds keepaliveTimeout,
+        WebsocketCompression::Counter& trafficCounter
+    );
+
+    TwitchAuth& twitchAuth;
+    HttpClient& httpClient;
+    RewardRedemptionQueue& rewardRedemptionQueue;
+    RedemptionReconciler& redemptionReconciler;
+    TlsContext& tlsContext;
+    DnsCache& dnsCache;
+    HappyEyeballsConnector& happyEyeballsConnector;
+    WebsocketCompression& websocketCompression;
+    std::atomic<bool> enabled;
+    IoThreadPool eventsubThread;
+    boost::asio::deadline_timer reconnectCondVar;
+    ReconnectBackoff reconnectBackoff;
+    /// Incremented by reconnect(). Only used on eventsubThread.
+    std::uint64_t reconnectGeneration;
+};
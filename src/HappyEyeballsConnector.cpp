@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HappyEyeballsConnector.h"
+
+#include <memory>
+#include <utility>
+#include <variant>
+
+#include "Log.h"
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+using namespace boost::asio::experimental::awaitable_operators;
+
+HappyEyeballsConnector::HappyEyeballsConnector() = default;
+
+HappyEyeballsConnector::~HappyEyeballsConnector() = default;
+
+asio::awaitable<void> HappyEyeballsConnector::connect(
+    tcp::socket& socket,
+    const std::string& host,
+    const DnsCache::Results& resolveResults
+) {
+    std::vector<tcp::endpoint> endpoints = sortEndpoints(host, resolveResults);
+    if (endpoints.empty()) {
+        throw boost::system::system_error(asio::error::host_not_found);
+    }
+
+    // The attempts run in parallel and share the timers, so they are serialized on a strand.
+    // Cancelling the returned operation, e.g. on a timeout, cancels all attempts in progress.
+    std::unique_ptr<tcp::socket> connectedSocket = co_await asio::co_spawn(
+        asio::make_strand(socket.get_executor()),
+        asyncConnectFrom(socket.get_executor(), endpoints, 0),
+        asio::use_awaitable
+    );
+    socket = std::move(*connectedSocket);
+    rememberFamily(host, socket);
+}
+
+void HappyEyeballsConnector::clear() {
+    std::lock_guard guard(preferIpv6ByHostMutex);
+    preferIpv6ByHost.clear();
+}
+
+std::vector<tcp::endpoint> HappyEyeballsConnector::sortEndpoints(
+    const std::string& host,
+    const DnsCache::Results& resolveResults
+) {
+    // Without any history, prefer IPv6, as RFC 8305 recommends.
+    bool preferIpv6 = true;
+    {
+        std::lock_guard guard(preferIpv6ByHostMutex);
+        auto it = preferIpv6ByHost.find(host);
+        if (it != preferIpv6ByHost.end()) {
+            preferIpv6 = it->second;
+        }
+    }
+
+    std::vector<tcp::endpoint> preferred;
+    std::vector<tcp::endpoint> other;
+    for (const auto& entry : resolveResults) {
+        (entry.endpoint().address().is_v6() == preferIpv6 ? preferred : other).push_back(entry.endpoint());
+    }
+
+    std::vector<tcp::endpoint> endpoints;
+    endpoints.reserve(preferred.size() + other.size());
+    for (std::size_t i = 0; i < preferred.size() || i < other.size(); i++) {
+        if (i < preferred.size()) {
+            endpoints.push_back(preferred[i]);
+        }
+        if (i < other.size()) {
+            endpoints.push_back(other[i]);
+        }
+    }
+    return endpoints;
+}
+
+void HappyEyeballsConnector::rememberFamily(const std::string& host, const tcp::socket& socket) {
+    boost::system::error_code ec;
+    tcp::endpoint endpoint = socket.remote_endpoint(ec);
+    if (ec) {
+        return;
+    }
+    bool isIpv6 = endpoint.address().is_v6();
+
+    std::lock_guard guard(preferIpv6ByHostMutex);
+    auto [it, inserted] = preferIpv6ByHost.try_emplace(host, isIpv6);
+    if (!inserted && it->second != isIpv6) {
+        log(LOG_INFO, "Connections to {} now prefer {}", host, isIpv6 ? "IPv6" : "IPv4");
+        it->second = isIpv6;
+    }
+}
+
+asio::awaitable<std::unique_ptr<tcp::socket>> HappyEyeballsConnector::asyncConnectFrom(
+    asio::any_io_executor socketExecutor,
+    const std::vector<tcp::endpoint>& endpoints,
+    std::size_t index
+) {
+    auto socket = std::make_unique<tcp::socket>(socketExecutor);
+    if (index + 1 == endpoints.size()) {
+        co_await socket->async_connect(endpoints[index], asio::use_awaitable);
+        co_return socket;
+    }
+
+    asio::steady_timer nextAttemptTimer{co_await asio::this_coro::executor, CONNECTION_ATTEMPT_DELAY};
+
+    // Completes with the first attempt that succeeds, or throws the error of this attempt if all of them fail.
+    std::variant<std::monostate, std::unique_ptr<tcp::socket>> result = co_await (
+        asyncAttempt(*socket, endpoints[index], nextAttemptTimer) ||
+        asyncStartNextAttempt(socketExecutor, endpoints, index + 1, nextAttemptTimer)
+    );
+    if (result.index() == 0) {
+        co_return socket;
+    }
+    co_return std::get<1>(std::move(result));
+}
+
+asio::awaitable<void> HappyEyeballsConnector::asyncAttempt(
+    tcp::socket& socket,
+    const tcp::endpoint& endpoint,
+    asio::steady_timer& nextAttemptTimer
+) {
+    try {
+        co_await socket.async_connect(endpoint, asio::use_awaitable);
+    } catch (const boost::system::system_error&) {
+        // Don't wait for the attempt delay to run out, start the next attempt right away.
+        nextAttemptTimer.cancel();
+        throw;
+    }
+}
+
+asio::awaitable<std::unique_ptr<tcp::socket>> HappyEyeballsConnector::asyncStartNextAttempt(
+    asio::any_io_executor socketExecutor,
+    const std::vector<tcp::endpoint>& endpoints,
+    std::size_t index,
+    asio::steady_timer& nextAttemptTimer
+) {
+    boost::system::error_code ec;
+    co_await nextAttemptTimer.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    // The timer is also cancelled by a failed attempt, so check whether this whole branch has been cancelled.
+    asio::cancellation_state cancellationState = co_await asio::this_coro::cancellation_state;
+    if (cancellationState.cancelled() != asio::cancellation_type::none) {
+        throw boost::system::system_error(asio::error::operation_aborted);
+    }
+    co_return co_await asyncConnectFrom(std::move(socketExecutor), endpoints, index);
+}
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BoostAsio.h"
+#include "DnsCache.h"
+
+/// Connects TCP sockets the way Happy Eyeballs (RFC 8305) does: the resolved addresses are interleaved by family,
+/// and a new connection attempt is started every CONNECTION_ATTEMPT_DELAY, or as soon as the previous one fails,
+/// without abandoning the attempts in progress. The first established connection wins, the rest are cancelled.
+/// That way, a dead IPv6 route delays connecting by CONNECTION_ATTEMPT_DELAY rather than by the OS connect timeout.
+///
+/// The family of the winning address is remembered per host and tried first on the next connection.
+class HappyEyeballsConnector {
+public:
+    static constexpr std::chrono::milliseconds CONNECTION_ATTEMPT_DELAY{250};
+
+    HappyEyeballsConnector();
+    ~HappyEyeballsConnector();
+
+    /// Connects the socket, which must not be open, to one of the addresses of the host.
+    boost::asio::awaitable<void> connect(
+        boost::asio::ip::tcp::socket& socket,
+        const std::string& host,
+        const DnsCache::Results& resolveResults
+    );
+
+    /// Forgets the preferred families, e.g. when the network has changed.
+    void clear();
+
+private:
+    std::vector<boost::asio::ip::tcp::endpoint> sortEndpoints(
+        const std::string& host,
+        const DnsCache::Results& resolveResults
+    );
+    void rememberFamily(const std::string& host, const boost::asio::ip::tcp::socket& socket);
+    static boost::asio::awaitable<std::unique_ptr<boost::asio::ip::tcp::socket>> asyncConnectFrom(
+        boost::asio::any_io_executor socketExecutor,
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+        std::size_t index
+    );
+    static boost::asio::awaitable<void> asyncAttempt(
+        boost::asio::ip::tcp::socket& socket,
+        const boost::asio::ip::tcp::endpoint& endpoint,
+        boost::asio::steady_timer& nextAttemptTimer
+    );
+    static boost::asio::awaitable<std::unique_ptr<boost::asio::ip::tcp::socket>> asyncStartNextAttempt(
+        boost::asio::any_io_executor socketExecutor,
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+        std::size_t index,
+        boost::asio::steady_timer& nextAttemptTimer
+    );
+
+    std::map<std::string, bool> preferIpv6ByHost;
+    std::mutex preferIpv6ByHostMutex;
+};
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HelixRequestScheduler.h"
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+
+namespace asio = boost::asio;
+namespace http = boost::beast::http;
+using namespace std::chrono_literals;
+
+// The part of the bucket that's kept for the requests of higher priorities.
+static constexpr std::array<double, 5> RESERVED_BUCKET_FRACTION = {0, 0.1, 0.25, 0.5, 0.5};
+// A waiter is woken up when a response updates the bucket, but in case the bucket is refilled on its own,
+// or the notification races with the start of the wait, the waiter rechecks at least this often.
+static const auto WAITER_RECHECK_PERIOD = 250ms;
+
+static std::optional<std::int64_t> parseIntHeader(const http::fields& headers, std::string_view name);
+
+HelixRequestScheduler::HelixRequestScheduler(asio::io_context& ioContext)
+    : ioContext(ioContext), inFlight(0), waiting{} {}
+
+HelixRequestScheduler::~HelixRequestScheduler() = default;
+
+HelixRequestScheduler::Slot::Slot(HelixRequestScheduler& scheduler, bool usesBucket)
+    : scheduler(&scheduler), usesBucket(usesBucket) {}
+
+HelixRequestScheduler::Slot::Slot(Slot&& other) noexcept
+    : scheduler(std::exchange(other.scheduler, nullptr)), usesBucket(other.usesBucket) {}
+
+HelixRequestScheduler::Slot::~Slot() {
+    if (scheduler) {
+        scheduler->release(usesBucket);
+    }
+}
+
+asio::awaitable<HelixRequestScheduler::Slot> HelixRequestScheduler::acquire(Priority priority) {
+    auto priorityIndex = static_cast<std::size_t>(priority);
+    auto timer = std::make_shared<asio::steady_timer>(ioContext);
+    {
+        std::lock_guard guard(mutex);
+        if (canStart(priority, std::chrono::system_clock::now())) {
+            co_return startRequest(priority);
+        }
+        waiting[priorityIndex]++;
+        waiterTimers.insert(timer);
+    }
+
+    while (true) {
+        timer->expires_after(WAITER_RECHECK_PERIOD);
+        boost::system::error_code ec;
+        co_await timer->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+
+        std::lock_guard guard(mutex);
+        // The waiter doesn't block the requests of its own priority while it's checking.
+        waiting[priorityIndex]--;
+        if (canStart(priority, std::chrono::system_clock::now())) {
+            waiterTimers.erase(timer);
+            co_return startRequest(priority);
+        }
+        waiting[priorityIndex]++;
+    }
+}
+
+void HelixRequestScheduler::onResponse(http::status status, const http::fields& headers) {
+    std::optional<std::int64_t> newLimit = parseIntHeader(headers, "Ratelimit-Limit");
+    std::optional<std::int64_t> newRemaining = parseIntHeader(headers, "Ratelimit-Remaining");
+    std::optional<std::int64_t> newResetAt = parseIntHeader(headers, "Ratelimit-Reset");
+    if (!newRemaining || !newResetAt) {
+        return;
+    }
+
+    {
+        std::lock_guard guard(mutex);
+        if (newLimit) {
+            limit = newLimit;
+        }
+        remaining = status == http::status::too_many_requests ? 0 : newRemaining.value();
+        resetAt = std::chrono::system_clock::time_point(std::chrono::seconds(newResetAt.value()));
+    }
+    notifyWaiters();
+}
+
+bool HelixRequestScheduler::canStart(Priority priority, std::chrono::system_clock::time_point now) const {
+    auto priorityIndex = static_cast<std::size_t>(priority);
+    for (std::size_t i = 0; i < priorityIndex; i++) {
+        if (waiting[i] > 0) {
+            return false;
+        }
+    }
+
+    if (priority == Priority::IMAGE || !remaining || now >= resetAt) {
+        // No requests have been made yet, or the bucket has been refilled since the last response.
+        return true;
+    }
+    std::int64_t available = remaining.value() - inFlight;
+    double reserved = static_cast<double>(limit.value_or(0)) * RESERVED_BUCKET_FRACTION[priorityIndex];
+    return static_cast<double>(available) > reserved;
+}
+
+HelixRequestScheduler::Slot HelixRequestScheduler::startRequest(Priority priority) {
+    bool usesBucket = priority != Priority::IMAGE;
+    if (usesBucket) {
+        inFlight++;
+    }
+    return Slot(*this, usesBucket);
+}
+
+void HelixRequestScheduler::release(bool usesBucket) {
+    if (!usesBucket) {
+        return;
+    }
+    {
+        std::lock_guard guard(mutex);
+        inFlight--;
+    }
+    notifyWaiters();
+}
+
+void HelixRequestScheduler::notifyWaiters() {
+    std::lock_guard guard(mutex);
+    for (const auto& timer : waiterTimers) {
+        asio::post(ioContext, [timer] {
+            timer->cancel();
+        });
+    }
+}
+
+std::optional<std::int64_t> parseIntHeader(const http::fields& headers, std::string_view name) {
+    auto it = headers.find(boost::beast::string_view(name.data(), name.size()));
+    if (it == headers.end()) {
+        return {};
+    }
+    auto value = it->value();
+    std::int64_t result;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc()) {
+        return {};
+    }
+    return result;
+}
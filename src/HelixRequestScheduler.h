@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+
+#include "BoostAsio.h"
+#include "Log.h"
+
+/// Orders requests to Twitch by priority and keeps them within the Helix rate limit bucket, which is tracked
+/// with the Ratelimit-* response headers. When the bucket runs low, lower priority requests are delayed until
+/// it's refilled, so that the redemption status updates don't fail with 429 Too Many Requests.
+/// Read https://dev.twitch.tv/docs/api/guide/#twitch-rate-limits for the details.
+class HelixRequestScheduler {
+public:
+    /// From the highest priority to the lowest. Images are downloaded from the CDN, so they don't use the bucket,
+    /// but they still wait for the Helix requests to go first.
+    enum class Priority {
+        REDEMPTION_STATUS,
+        REWARD_CRUD,
+        REWARD_RELOAD,
+        /// Loading the missed redemptions, which is done in the background and can wait the longest.
+        REDEMPTION_RECONCILE,
+        IMAGE,
+    };
+
+    HelixRequestScheduler(boost::asio::io_context& ioContext);
+    ~HelixRequestScheduler();
+
+    /// A permission to send one request. Destroy it once the response has been received.
+    class Slot {
+    public:
+        Slot(Slot&& other) noexcept;
+        Slot& operator=(Slot&&) = delete;
+        ~Slot();
+
+    private:
+        friend class HelixRequestScheduler;
+        Slot(HelixRequestScheduler& scheduler, bool usesBucket);
+
+        HelixRequestScheduler* scheduler;
+        bool usesBucket;
+    };
+
+    boost::asio::awaitable<Slot> acquire(Priority priority);
+    void onResponse(boost::beast::http::status status, const boost::beast::http::fields& headers);
+
+    /// Sends the request when its turn comes. If Twitch still answers with 429, waits for the bucket to be refilled
+    /// and sends the request again, as rate limited requests aren't processed by Twitch.
+    template <typename Response>
+    boost::asio::awaitable<Response> run(
+        Priority priority,
+        const std::function<boost::asio::awaitable<Response>()>& makeRequest
+    );
+
+private:
+    static constexpr std::size_t PRIORITY_COUNT = 5;
+
+    bool canStart(Priority priority, std::chrono::system_clock::time_point now) const;
+    Slot startRequest(Priority priority);
+    void release(bool usesBucket);
+    void notifyWaiters();
+
+    boost::asio::io_context& ioContext;
+    std::optional<std::int64_t> limit;
+    std::optional<std::int64_t> remaining;
+    std::chrono::system_clock::time_point resetAt;
+    std::int64_t inFlight;
+    std::array<std::size_t, PRIORITY_COUNT> waiting;
+    std::set<std::shared_ptr<boost::asio::steady_timer>> waiterTimers;
+    mutable std::mutex mutex;
+};
+
+template <typename Response>
+boost::asio::awaitable<Response> HelixRequestScheduler::run(
+    Priority priority,
+    const std::function<boost::asio::awaitable<Response>()>& makeRequest
+) {
+    static const int MAX_ATTEMPTS = 3;
+    for (int attempt = 1;; attempt++) {
+        Slot slot = co_await acquire(priority);
+        Response response = co_await makeRequest();
+        onResponse(response.status, response.headers);
+        if (response.status != boost::beast::http::status::too_many_requests || attempt == MAX_ATTEMPTS) {
+            co_return response;
+        }
+        log(LOG_WARNING, "Helix rate limit exceeded, waiting for the bucket to refill");
+    }
+}
@@ -0,0 +1,369 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "Http2Connection.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "Log.h"
+
+namespace asio = boost::asio;
+namespace http = boost::beast::http;
+
+const std::string_view Http2Connection::ALPN_PROTOCOLS("\x02h2\x08http/1.1", 12);
+
+// HTTP/2 forbids the connection-specific header fields of HTTP/1.1, see RFC 9113, section 8.2.2.
+static const std::set<std::string, std::less<>> CONNECTION_SPECIFIC_HEADERS = {
+    "connection",
+    "host",
+    "keep-alive",
+    "proxy-connection",
+    "te",
+    "transfer-encoding",
+    "upgrade",
+};
+static const std::uint32_t MAX_CONCURRENT_STREAMS = 100;
+
+bool Http2Connection::isNegotiated(SSL* ssl) {
+    const unsigned char* protocol = nullptr;
+    unsigned int protocolLength = 0;
+    SSL_get0_alpn_selected(ssl, &protocol, &protocolLength);
+    return std::string_view(reinterpret_cast<const char*>(protocol), protocolLength) == "h2";
+}
+
+Http2Connection::Http2Connection(std::unique_ptr<HttpConnectionPool::Stream> stream)
+    : stream(std::move(stream)), strand(asio::make_strand(this->stream->get_executor())), open(true), writing(false),
+      pingAckTimer(strand), pingAckPending(false) {
+    nghttp2_session_callbacks* callbacks;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, onHeader);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, onDataChunk);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, onFrame);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, onStreamClose);
+    nghttp2_session* newSession;
+    int result = nghttp2_session_client_new(&newSession, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+    if (result != 0) {
+        throw std::runtime_error(nghttp2_strerror(result));
+    }
+    session.reset(newSession);
+}
+
+Http2Connection::~Http2Connection() = default;
+
+void Http2Connection::start() {
+    asio::post(strand, [self = shared_from_this()] {
+        nghttp2_settings_entry settings[] = {{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS}};
+        nghttp2_submit_settings(self->session.get(), NGHTTP2_FLAG_NONE, settings, std::size(settings));
+        asio::co_spawn(self->strand, self->asyncReadLoop(self), asio::detached);
+        self->flushLater();
+    });
+}
+
+bool Http2Connection::isOpen() const {
+    return open;
+}
+
+void Http2Connection::ping(std::chrono::steady_clock::duration ackTimeout) {
+    asio::post(strand, [self = shared_from_this(), ackTimeout] {
+        if (!self->open || self->pingAckPending) {
+            return;
+        }
+        nghttp2_submit_ping(self->session.get(), NGHTTP2_FLAG_NONE, nullptr);
+        self->pingAckPending = true;
+        self->pingAckTimer.expires_after(ackTimeout);
+        self->pingAckTimer.async_wait([self](boost::system::error_code ec) {
+            if (!ec && self->pingAckPending && self->open) {
+                log(LOG_WARNING, "HTTP/2 PING hasn't been acknowledged, closing the connection");
+                self->close(asio::error::timed_out);
+            }
+        });
+        self->flushLater();
+    });
+}
+
+void Http2Connection::shutdown() {
+    asio::post(strand, [self = shared_from_this()] {
+        if (self->open) {
+            self->close(asio::error::network_reset);
+        }
+    });
+}
+
+asio::awaitable<Http2Connection::Response> Http2Connection::request(
+    const std::string& host,
+    const http::request<http::string_body>& request
+) {
+    // Run on the strand, like everything else that touches the session.
+    co_return co_await asio::co_spawn(strand, asyncRequest(shared_from_this(), host, request), asio::use_awaitable);
+}
+
+Http2Connection::PendingStream::PendingStream(asio::strand<asio::any_io_executor>& strand)
+    : response{}, requestBodyOffset(0), closed(false), closedSignal(strand, asio::steady_timer::time_point::max()) {}
+
+void Http2Connection::SessionDeleter::operator()(nghttp2_session* session) const {
+    nghttp2_session_del(session);
+}
+
+asio::awaitable<Http2Connection::Response> Http2Connection::asyncRequest(
+    std::shared_ptr<Http2Connection> self,
+    const std::string& host,
+    const http::request<http::string_body>& request
+) {
+    // Handle the cancellation ourselves, so that the stream is reset.
+    co_await asio::this_coro::throw_if_cancelled(false);
+    if (!open) {
+        throw boost::system::system_error(asio::error::not_connected);
+    }
+
+    auto pendingStream = std::make_shared<PendingStream>(strand);
+    pendingStream->requestBody = request.body();
+
+    // nghttp2 copies the header fields when the request is submitted, so they only have to outlive the call.
+    std::string method(request.method_string());
+    std::string path(request.target());
+    std::vector<std::string> lowercaseNames;
+    lowercaseNames.reserve(std::distance(request.begin(), request.end()));
+    std::vector<nghttp2_nv> headers;
+    auto addHeader = [&headers](std::string_view name, std::string_view value) {
+        headers.push_back(nghttp2_nv{
+            reinterpret_cast<std::uint8_t*>(const_cast<char*>(name.data())),
+            reinterpret_cast<std::uint8_t*>(const_cast<char*>(value.data())),
+            name.size(),
+            value.size(),
+            NGHTTP2_NV_FLAG_NONE,
+        });
+    };
+    addHeader(":method", method);
+    addHeader(":scheme", "https");
+    addHeader(":authority", host);
+    addHeader(":path", path);
+    for (const auto& field : request) {
+        std::string& name = lowercaseNames.emplace_back(field.name_string());
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+        if (!CONNECTION_SPECIFIC_HEADERS.contains(name)) {
+            addHeader(name, field.value());
+        }
+    }
+
+    nghttp2_data_provider2 bodyProvider{};
+    bodyProvider.source.ptr = pendingStream.get();
+    bodyProvider.read_callback = readRequestBody;
+    std::int32_t streamId = nghttp2_submit_request2(
+        session.get(),
+        nullptr,
+        headers.data(),
+        headers.size(),
+        request.body().empty() ? nullptr : &bodyProvider,
+        pendingStream.get()
+    );
+    if (streamId < 0) {
+        log(LOG_ERROR, "Failed to submit an HTTP/2 request: {}", nghttp2_strerror(streamId));
+        throw boost::system::system_error(asio::error::not_connected);
+    }
+    streams[streamId] = pendingStream;
+    flushLater();
+
+    // Everything runs on the strand, so the stream can't be closed between the check and the start of the wait.
+    while (!pendingStream->closed) {
+        boost::system::error_code ec;
+        co_await pendingStream->closedSignal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+        asio::cancellation_state cancellationState = co_await asio::this_coro::cancellation_state;
+        if (!pendingStream->closed && cancellationState.cancelled() != asio::cancellation_type::none) {
+            nghttp2_submit_rst_stream(session.get(), NGHTTP2_FLAG_NONE, streamId, NGHTTP2_CANCEL);
+            flushLater();
+            throw boost::system::system_error(asio::error::operation_aborted);
+        }
+    }
+    if (pendingStream->error) {
+        throw boost::system::system_error(pendingStream->error);
+    }
+    co_return std::move(pendingStream->response);
+}
+
+asio::awaitable<void> Http2Connection::asyncReadLoop(std::shared_ptr<Http2Connection> self) {
+    std::array<std::uint8_t, 16384> buffer;
+    boost::system::error_code ec;
+    while (true) {
+        std::size_t bytesRead = co_await stream->async_read_some(
+            asio::buffer(buffer), asio::redirect_error(asio::use_awaitable, ec)
+        );
+        if (ec) {
+            break;
+        }
+        nghttp2_ssize result = nghttp2_session_mem_recv2(session.get(), buffer.data(), bytesRead);
+        if (result < 0) {
+            log(LOG_ERROR, "HTTP/2 protocol error: {}", nghttp2_strerror(static_cast<int>(result)));
+            ec = asio::error::connection_aborted;
+            break;
+        }
+        // Send the acknowledgements and the flow control updates.
+        co_await asyncFlush(self);
+        if (!nghttp2_session_want_read(session.get()) && !nghttp2_session_want_write(session.get())) {
+            // The server has sent GOAWAY and all the streams have been closed.
+            ec = asio::error::eof;
+            break;
+        }
+    }
+    close(ec);
+}
+
+asio::awaitable<void> Http2Connection::asyncFlush(std::shared_ptr<Http2Connection> self) {
+    if (writing) {
+        co_return;
+    }
+    writing = true;
+    std::string output;
+    while (true) {
+        output.clear();
+        const std::uint8_t* data;
+        nghttp2_ssize length;
+        while ((length = nghttp2_session_mem_send2(session.get(), &data)) > 0) {
+            output.append(reinterpret_cast<const char*>(data), static_cast<std::size_t>(length));
+        }
+        if (length < 0) {
+            log(LOG_ERROR, "HTTP/2 session error: {}", nghttp2_strerror(static_cast<int>(length)));
+            writing = false;
+            close(asio::error::connection_aborted);
+            co_return;
+        }
+        if (output.empty()) {
+            break;
+        }
+
+        boost::system::error_code ec;
+        co_await asio::async_write(*stream, asio::buffer(output), asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            writing = false;
+            close(ec);
+            co_return;
+        }
+    }
+    writing = false;
+}
+
+void Http2Connection::flushLater() {
+    asio::co_spawn(strand, asyncFlush(shared_from_this()), asio::detached);
+}
+
+void Http2Connection::close(boost::system::error_code ec) {
+    open = false;
+    pingAckTimer.cancel();
+    if (!ec) {
+        ec = asio::error::connection_reset;
+    }
+    for (auto& [streamId, pendingStream] : streams) {
+        closeStream(*pendingStream, ec);
+    }
+    streams.clear();
+    boost::system::error_code ignored;
+    stream->next_layer().close(ignored);
+}
+
+void Http2Connection::closeStream(PendingStream& pendingStream, boost::system::error_code ec) {
+    pendingStream.closed = true;
+    pendingStream.error = ec;
+    pendingStream.closedSignal.cancel();
+}
+
+int Http2Connection::onHeader(
+    nghttp2_session* session,
+    const nghttp2_frame* frame,
+    const std::uint8_t* name,
+    std::size_t nameLength,
+    const std::uint8_t* value,
+    std::size_t valueLength,
+    std::uint8_t,
+    void*
+) {
+    if (frame->hd.type != NGHTTP2_HEADERS) {
+        return 0;
+    }
+    auto pendingStream =
+        static_cast<PendingStream*>(nghttp2_session_get_stream_user_data(session, frame->hd.stream_id));
+    if (!pendingStream) {
+        return 0;
+    }
+
+    std::string_view nameView(reinterpret_cast<const char*>(name), nameLength);
+    std::string_view valueView(reinterpret_cast<const char*>(value), valueLength);
+    if (nameView == ":status") {
+        unsigned status = 0;
+        std::from_chars(valueView.data(), valueView.data() + valueView.size(), status);
+        pendingStream->response.status = static_cast<http::status>(status);
+    } else {
+        pendingStream->response.headers.insert(nameView, valueView);
+    }
+    return 0;
+}
+
+int Http2Connection::onDataChunk(
+    nghttp2_session* session,
+    std::uint8_t,
+    std::int32_t streamId,
+    const std::uint8_t* data,
+    std::size_t length,
+    void*
+) {
+    auto pendingStream = static_cast<PendingStream*>(nghttp2_session_get_stream_user_data(session, streamId));
+    if (pendingStream) {
+        pendingStream->response.body.append(reinterpret_cast<const char*>(data), length);
+    }
+    return 0;
+}
+
+int Http2Connection::onFrame(nghttp2_session*, const nghttp2_frame* frame, void* userData) {
+    auto connection = static_cast<Http2Connection*>(userData);
+    if (frame->hd.type == NGHTTP2_GOAWAY) {
+        // The streams that have already been started are still processed.
+        connection->open = false;
+    } else if (frame->hd.type == NGHTTP2_PING && (frame->hd.flags & NGHTTP2_FLAG_ACK)) {
+        connection->pingAckPending = false;
+        connection->pingAckTimer.cancel();
+    }
+    return 0;
+}
+
+int Http2Connection::onStreamClose(nghttp2_session*, std::int32_t streamId, std::uint32_t errorCode, void* userData) {
+    auto connection = static_cast<Http2Connection*>(userData);
+    auto it = connection->streams.find(streamId);
+    if (it == connection->streams.end()) {
+        return 0;
+    }
+    if (errorCode != NGHTTP2_NO_ERROR) {
+        log(LOG_WARNING, "HTTP/2 stream closed with error: {}", nghttp2_http2_strerror(errorCode));
+    }
+    connection->closeStream(
+        *it->second, errorCode == NGHTTP2_NO_ERROR ? boost::system::error_code() : asio::error::connection_reset
+    );
+    connection->streams.erase(it);
+    return 0;
+}
+
+nghttp2_ssize Http2Connection::readRequestBody(
+    nghttp2_session*,
+    std::int32_t,
+    std::uint8_t* buffer,
+    std::size_t length,
+    std::uint32_t* dataFlags,
+    nghttp2_data_source* source,
+    void*
+) {
+    auto pendingStream = static_cast<PendingStream*>(source->ptr);
+    std::size_t remaining = pendingStream->requestBody.size() - pendingStream->requestBodyOffset;
+    std::size_t bytesToCopy = std::min(length, remaining);
+    std::memcpy(buffer, pendingStream->requestBody.data() + pendingStream->requestBodyOffset, bytesToCopy);
+    pendingStream->requestBodyOffset += bytesToCopy;
+    if (pendingStream->requestBodyOffset == pendingStream->requestBody.size()) {
+        *dataFlags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+    return static_cast<nghttp2_ssize>(bytesToCopy);
+}
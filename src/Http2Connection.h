@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <nghttp2/nghttp2.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "BoostAsio.h"
+#include "HttpConnectionPool.h"
+
+/// An HTTP/2 connection to a host that multiplexes concurrent requests over one TLS stream, using nghttp2.
+/// All the work with the nghttp2 session is done on a strand, so requests can be made from any thread.
+class Http2Connection : public std::enable_shared_from_this<Http2Connection> {
+public:
+    /// The ALPN protocol list in the wire format: HTTP/2, with HTTP/1.1 as a fallback.
+    static const std::string_view ALPN_PROTOCOLS;
+
+    /// Whether the server has chosen HTTP/2 during the TLS handshake.
+    static bool isNegotiated(SSL* ssl);
+
+    Http2Connection(std::unique_ptr<HttpConnectionPool::Stream> stream);
+    ~Http2Connection();
+
+    /// Sends the connection preface and starts reading the responses. Call once after construction.
+    void start();
+
+    /// Whether new requests can be sent. A connection is closed after an error or when the server sends GOAWAY.
+    bool isOpen() const;
+
+    /// Sends a PING frame, so that the idle connection isn't dropped by the server or by a NAT on the way.
+    /// If the acknowledgement doesn't arrive within ackTimeout, the connection is considered dead and is closed.
+    void ping(std::chrono::steady_clock::duration ackTimeout);
+
+    /// Closes the connection and fails the pending requests, e.g. when the network has changed. Thread-safe.
+    void shutdown();
+
+    struct Response {
+        boost::beast::http::status status;
+        boost::beast::http::fields headers;
+        std::string body;
+    };
+
+    /// Sends the request and reads the whole response. Throws boost::system::system_error if the connection fails.
+    boost::asio::awaitable<Response> request(
+        const std::string& host,
+        const boost::beast::http::request<boost::beast::http::string_body>& request
+    );
+
+private:
+    struct PendingStream {
+        PendingStream(boost::asio::strand<boost::asio::any_io_executor>& strand);
+
+        Response response;
+        std::string requestBody;
+        std::size_t requestBodyOffset;
+        bool closed;
+        boost::system::error_code error;
+        /// Used as a condition variable: cancelled once the stream is closed.
+        boost::asio::steady_timer closedSignal;
+    };
+
+    struct SessionDeleter {
+        void operator()(nghttp2_session* session) const;
+    };
+
+    boost::asio::awaitable<Response> asyncRequest(
+        std::shared_ptr<Http2Connection> self,
+        const std::string& host,
+        const boost::beast::http::request<boost::beast::http::string_body>& request
+    );
+    boost::asio::awaitable<void> asyncReadLoop(std::shared_ptr<Http2Connection> self);
+    /// Writes everything nghttp2 has queued. Only one flush writes at a time, the others return immediately,
+    /// as the writing one picks up their data.
+    boost::asio::awaitable<void> asyncFlush(std::shared_ptr<Http2Connection> self);
+    void flushLater();
+    void close(boost::system::error_code ec);
+    void closeStream(PendingStream& pendingStream, boost::system::error_code ec);
+
+    static int onHeader(
+        nghttp2_session* session,
+        const nghttp2_frame* frame,
+        const std::uint8_t* name,
+        std::size_t nameLength,
+        const std::uint8_t* value,
+        std::size_t valueLength,
+        std::uint8_t flags,
+        void* userData
+    );
+    static int onDataChunk(
+        nghttp2_session* session,
+        std::uint8_t flags,
+        std::int32_t streamId,
+        const std::uint8_t* data,
+        std::size_t length,
+        void* userData
+    );
+    static int onFrame(nghttp2_session* session, const nghttp2_frame* frame, void* userData);
+    static int onStreamClose(nghttp2_session* session, std::int32_t streamId, std::uint32_t errorCode, void* userData);
+    static nghttp2_ssize readRequestBody(
+        nghttp2_session* session,
+        std::int32_t streamId,
+        std::uint8_t* buffer,
+        std::size_t length,
+        std::uint32_t* dataFlags,
+        nghttp2_data_source* source,
+        void* userData
+    );
+
+    std::unique_ptr<HttpConnectionPool::Stream> stream;
+    boost::asio::strand<boost::asio::any_io_executor> strand;
+    std::unique_ptr<nghttp2_session, SessionDeleter> session;
+    std::map<std::int32_t, std::shared_ptr<PendingStream>> streams;
+    std::atomic<bool> open;
+    bool writing;
+    /// Expires if the last PING hasn't been acknowledged in time.
+    boost::asio::steady_timer pingAckTimer;
+    bool pingAckPending;
+};
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HttpCache.h"
+
+#include <fmt/core.h>
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <array>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/json.hpp>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <vector>
+
+#include "Log.h"
+
+namespace asio = boost::asio;
+namespace http = boost::beast::http;
+namespace json = boost::json;
+
+// The file in the cache directory with the id of the user the entries have been cached for.
+static const char* const USER_FILE_NAME = "user";
+
+HttpCache::HttpCache(std::filesystem::path directory)
+    : directory(std::move(directory)), memorySize(0), diskSize(0), diskThread(1) {
+    if (this->directory.empty()) {
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(this->directory, ec);
+    if (ec) {
+        log(LOG_WARNING, "Failed to create the HTTP cache directory: {}", ec.message());
+    }
+    std::ifstream userFile(getUserFilePath());
+    std::string savedUserId;
+    if (std::getline(userFile, savedUserId)) {
+        userId = savedUserId;
+    }
+    asio::post(diskThread.ioContext, [this] {
+        loadDiskIndex();
+    });
+}
+
+HttpCache::~HttpCache() = default;
+
+asio::awaitable<std::shared_ptr<const HttpCache::Entry>> HttpCache::asyncFind(const std::string& key) {
+    {
+        std::lock_guard guard(entriesMutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            co_return it->second;
+        }
+    }
+    if (directory.empty()) {
+        co_return nullptr;
+    }
+
+    std::shared_ptr<const Entry> entry =
+        co_await asio::co_spawn(diskThread.ioContext, asyncLoadFromDisk(key), asio::use_awaitable);
+    if (entry) {
+        std::lock_guard guard(entriesMutex);
+        storeInMemory(key, entry);
+    }
+    co_return entry;
+}
+
+void HttpCache::store(const std::string& key, Entry entry) {
+    if (entry.body.size() > MAX_ENTRY_SIZE) {
+        return;
+    }
+    auto sharedEntry = std::make_shared<const Entry>(std::move(entry));
+    if (!directory.empty() && !sharedEntry->isPrivate) {
+        asio::post(diskThread.ioContext, [this, key, sharedEntry] {
+            saveToDisk(key, *sharedEntry);
+        });
+    }
+    std::lock_guard guard(entriesMutex);
+    storeInMemory(key, std::move(sharedEntry));
+}
+
+void HttpCache::clear() {
+    {
+        std::lock_guard guard(entriesMutex);
+        clearMemory();
+    }
+    if (!directory.empty()) {
+        asio::post(diskThread.ioContext, [this] {
+            clearDisk();
+        });
+    }
+}
+
+void HttpCache::setUser(const std::optional<std::string>& newUserId) {
+    {
+        std::lock_guard guard(entriesMutex);
+        if (userId == newUserId) {
+            return;
+        }
+        userId = newUserId;
+        clearMemory();
+    }
+    if (directory.empty()) {
+        return;
+    }
+    asio::post(diskThread.ioContext, [this, newUserId] {
+        clearDisk();
+        if (newUserId) {
+            std::ofstream userFile(getUserFilePath(), std::ios::trunc);
+            userFile << newUserId.value();
+        }
+    });
+}
+
+void HttpCache::setValidators(http::request<http::string_body>& request, const Entry* entry) {
+    request.erase(http::field::if_none_match);
+    request.erase(http::field::if_modified_since);
+    if (!entry) {
+        return;
+    }
+    if (!entry->etag.empty()) {
+        request.set(http::field::if_none_match, entry->etag);
+    }
+    if (!entry->lastModified.empty()) {
+        request.set(http::field::if_modified_since, entry->lastModified);
+    }
+}
+
+std::optional<HttpCache::Entry> HttpCache::getValidators(const http::fields& header) {
+    std::string_view cacheControl = header[http::field::cache_control];
+    if (boost::algorithm::icontains(cacheControl, "no-store")) {
+        return {};
+    }
+    Entry entry{std::string(header[http::field::etag]), std::string(header[http::field::last_modified]), "", false};
+    if (entry.etag.empty() && entry.lastModified.empty()) {
+        return {};
+    }
+    entry.isPrivate = boost::algorithm::icontains(cacheControl, "private");
+    return entry;
+}
+
+void HttpCache::clearMemory() {
+    entries.clear();
+    insertionOrder.clear();
+    memorySize = 0;
+}
+
+void HttpCache::storeInMemory(const std::string& key, std::shared_ptr<const Entry> entry) {
+    auto [it, inserted] = entries.try_emplace(key);
+    if (inserted) {
+        insertionOrder.push_back(key);
+    } else {
+        memorySize -= it->second->body.size();
+    }
+    memorySize += entry->body.size();
+    it->second = std::move(entry);
+
+    // The evicted entries can still be loaded from the disk.
+    while (memorySize > MAX_MEMORY_SIZE && insertionOrder.size() > 1) {
+        auto evicted = entries.find(insertionOrder.front());
+        memorySize -= evicted->second->body.size();
+        entries.erase(evicted);
+        insertionOrder.pop_front();
+    }
+}
+
+std::filesystem::path HttpCache::getFilePath(const std::string& key) const {
+    std::array<unsigned char, SHA256_DIGEST_LENGTH> hash;
+    SHA256(reinterpret_cast<const unsigned char*>(key.data()), key.size(), hash.data());
+    std::string fileName;
+    for (unsigned char byte : hash) {
+        fileName += fmt::format("{:02x}", byte);
+    }
+    return directory / fileName;
+}
+
+std::filesystem::path HttpCache::getUserFilePath() const {
+    return directory / USER_FILE_NAME;
+}
+
+void HttpCache::loadDiskIndex() {
+    struct File {
+        std::filesystem::file_time_type lastWriteTime;
+        std::filesystem::path path;
+        std::uintmax_t size;
+    };
+    std::vector<File> files;
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(directory, ec)) {
+        if (file.path() == getUserFilePath()) {
+            continue;
+        }
+        if (file.path().extension() == ".tmp") {
+            // Left over from a save that has been interrupted.
+            std::filesystem::remove(file.path(), ec);
+            continue;
+        }
+        std::uintmax_t size = file.file_size(ec);
+        std::filesystem::file_time_type lastWriteTime = file.last_write_time(ec);
+        if (!ec) {
+            files.push_back(File{lastWriteTime, file.path(), size});
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+        return a.lastWriteTime < b.lastWriteTime;
+    });
+    for (const File& file : files) {
+        addToDiskIndex(file.path, file.size);
+    }
+}
+
+// The file consists of a line with the metadata in JSON, followed by the body.
+asio::awaitable<std::shared_ptr<const HttpCache::Entry>> HttpCache::asyncLoadFromDisk(std::string key) const {
+    std::ifstream file(getFilePath(key), std::ios::binary);
+    if (!file) {
+        co_return nullptr;
+    }
+
+    try {
+        std::string metadataLine;
+        std::getline(file, metadataLine);
+        json::value metadata = json::parse(metadataLine);
+        if (value_to<std::string>(metadata.at("key")) != key) {
+            // A hash collision.
+            co_return nullptr;
+        }
+        auto entry = std::make_shared<Entry>();
+        entry->etag = value_to<std::string>(metadata.at("etag"));
+        entry->lastModified = value_to<std::string>(metadata.at("lastModified"));
+        entry->body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        co_return entry;
+    } catch (const std::exception& exception) {
+        log(LOG_WARNING, "Failed to load an HTTP cache entry: {}", exception.what());
+    }
+    co_return nullptr;
+}
+
+void HttpCache::saveToDisk(const std::string& key, const Entry& entry) {
+    std::filesystem::path filePath = getFilePath(key);
+    std::filesystem::path temporaryPath = filePath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        json::value metadata{{"key", key}, {"etag", entry.etag}, {"lastModified", entry.lastModified}};
+        file << serialize(metadata) << '\n';
+        file.write(entry.body.data(), static_cast<std::streamsize>(entry.body.size()));
+        if (!file) {
+            log(LOG_WARNING, "Failed to save an HTTP cache entry");
+            return;
+        }
+    }
+    // Replace the old file atomically, so that a concurrent load never sees a partially written one.
+    std::error_code ec;
+    std::filesystem::rename(temporaryPath, filePath, ec);
+    if (ec) {
+        log(LOG_WARNING, "Failed to save an HTTP cache entry: {}", ec.message());
+        return;
+    }
+    std::uintmax_t fileSize = std::filesystem::file_size(filePath, ec);
+    if (!ec) {
+        addToDiskIndex(filePath, fileSize);
+    }
+}
+
+void HttpCache::addToDiskIndex(const std::filesystem::path& filePath, std::uintmax_t fileSize) {
+    auto [it, inserted] = diskFileSizes.try_emplace(filePath, fileSize);
+    if (!inserted) {
+        diskSize -= it->second;
+        it->second = fileSize;
+        diskOrder.erase(std::find(diskOrder.begin(), diskOrder.end(), filePath));
+    }
+    diskOrder.push_back(filePath);
+    diskSize += fileSize;
+
+    while (diskSize > MAX_DISK_SIZE && diskOrder.size() > 1) {
+        std::error_code ec;
+        std::filesystem::remove(diskOrder.front(), ec);
+        auto evicted = diskFileSizes.find(diskOrder.front());
+        diskSize -= evicted->second;
+        diskFileSizes.erase(evicted);
+        diskOrder.pop_front();
+    }
+}
+
+void HttpCache::clearDisk() {
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(directory, ec)) {
+        std::filesystem::remove(file.path(), ec);
+    }
+    diskFileSizes.clear();
+    diskOrder.clear();
+    diskSize = 0;
+}
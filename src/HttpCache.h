@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "BoostAsio.h"
+#include "IoThreadPool.h"
+
+/// Keeps the bodies of GET responses along with their validators (ETag and Last-Modified), so that the next request
+/// for the same URL can be conditional and a 304 Not Modified response can be served from the cache.
+/// The entries are kept in memory and in a directory on disk, so that they survive restarts. The disk is only
+/// accessed from a thread of its own, so that the IO threads never wait for it.
+class HttpCache {
+public:
+    struct Entry {
+        std::string etag;
+        std::string lastModified;
+        std::string body;
+        /// The response is specific to the user (Cache-Control: private), so it's only kept in memory.
+        bool isPrivate = false;
+    };
+
+    /// Bigger bodies aren't cached.
+    static constexpr std::size_t MAX_ENTRY_SIZE = 1 << 20;
+
+    /// If the directory is empty, the entries are only kept in memory.
+    HttpCache(std::filesystem::path directory);
+    ~HttpCache();
+
+    /// The key is the host and the request target.
+    boost::asio::awaitable<std::shared_ptr<const Entry>> asyncFind(const std::string& key);
+    void store(const std::string& key, Entry entry);
+    void clear();
+    /// Clears the cache if it has been filled for another user, or if there's no user anymore. The user is
+    /// remembered on disk, so the entries survive restarts as long as the same user is logged in.
+    void setUser(const std::optional<std::string>& userId);
+
+    /// Makes the request conditional on the entry, or unconditional if there's no entry.
+    static void setValidators(
+        boost::beast::http::request<boost::beast::http::string_body>& request,
+        const Entry* entry
+    );
+    /// Returns the validators of the response, if it can be cached. The body has to be filled in by the caller.
+    static std::optional<Entry> getValidators(const boost::beast::http::fields& header);
+
+private:
+    static constexpr std::size_t MAX_MEMORY_SIZE = 16 << 20;
+    static constexpr std::uintmax_t MAX_DISK_SIZE = 64 << 20;
+
+    void clearMemory();
+    void storeInMemory(const std::string& key, std::shared_ptr<const Entry> entry);
+    std::filesystem::path getFilePath(const std::string& key) const;
+    std::filesystem::path getUserFilePath() const;
+
+    // Called on the disk thread only.
+    void loadDiskIndex();
+    boost::asio::awaitable<std::shared_ptr<const Entry>> asyncLoadFromDisk(std::string key) const;
+    void saveToDisk(const std::string& key, const Entry& entry);
+    void addToDiskIndex(const std::filesystem::path& filePath, std::uintmax_t fileSize);
+    void clearDisk();
+
+    const std::filesystem::path directory;
+    std::map<std::string, std::shared_ptr<const Entry>> entries;
+    /// The keys from the oldest to the newest entry, for eviction.
+    std::deque<std::string> insertionOrder;
+    std::size_t memorySize;
+    std::optional<std::string> userId;
+    std::mutex entriesMutex;
+
+    /// The sizes of the files on disk, and the files from the oldest to the newest, for eviction.
+    /// Only accessed on the disk thread.
+    std::map<std::filesystem::path, std::uintmax_t> diskFileSizes;
+    std::deque<std::filesystem::path> diskOrder;
+    std::uintmax_t diskSize;
+
+    /// Declared last, so that the thread is stopped before the rest is destructed.
+    IoThreadPool diskThread;
+};
@@ -3,17 +3,61 @@
 
 #include "HttpClient.h"
 
+#include <fmt/core.h>
+
+#include <charconv>
+#include <exception>
+#include <optional>
 #include <utility>
+#include <variant>
 
 #include "BoostAsio.h"
+#include "HttpHeaderBuilder.h"
+#include "Log.h"
 #include "TwitchAuth.h"
 
 namespace asio = boost::asio;
 namespace ssl = asio::ssl;
 namespace http = boost::beast::http;
 namespace json = boost::json;
+using namespace boost::asio::experimental::awaitable_operators;
+using namespace std::chrono_literals;
+
+static const std::size_t MAX_CONNECTIONS_PER_HOST = 6;
+// Twitch and GitHub close idle keep-alive connections after about a minute, so don't keep them for longer.
+static const auto IDLE_CONNECTION_TIMEOUT = 50s;
+// Check the prewarmed connections often enough to replace them before they are evicted from the pool as idle.
+static const auto PREWARM_CHECK_PERIOD = 40s;
+// The longest request target that can be built for an HttpEndpoint.
+static const std::size_t MAX_TARGET_SIZE = 1024;
+// While another request is connecting to an HTTP/2 host, wait for its connection instead of opening one more.
+static const auto HTTP2_CONNECT_RECHECK_PERIOD = 50ms;
+// A server that has once refused HTTP/2 may start supporting it, e.g. after a load balancer update.
+static const auto HTTP2_UNSUPPORTED_RECHECK_PERIOD = 1h;
+// An HTTP/2 connection that doesn't acknowledge a PING within this time is considered dead.
+static const auto HTTP2_PING_ACK_TIMEOUT = 10s;
+// Downloads, e.g. of reward images, have a unique path each, so they are put under one endpoint name per host.
+static const std::string_view DOWNLOAD_ENDPOINT_PATH = "/*";
 
-HttpClient::HttpClient(boost::asio::io_context& ioContext) : ioContext(ioContext) {}
+const HttpClient::Timeouts HttpClient::DEFAULT_TIMEOUTS{
+    .connect = 10s,
+    .tlsHandshake = 10s,
+    .write = 10s,
+    .read = 20s,
+};
+
+HttpClient::HttpClient(
+    boost::asio::io_context& ioContext,
+    TlsContext& tlsContext,
+    DnsCache& dnsCache,
+    HappyEyeballsConnector& happyEyeballsConnector,
+    HttpCache& httpCache,
+    const Timeouts& timeouts,
+    const HttpRetryPolicy::Config& retryConfig
+)
+    : ioContext(ioContext), tlsContext(tlsContext), dnsCache(dnsCache),
+      happyEyeballsConnector(happyEyeballsConnector), httpCache(httpCache), timeouts(timeouts),
+      retryPolicy(retryConfig), connectionPool(ioContext, MAX_CONNECTIONS_PER_HOST, IDLE_CONNECTION_TIMEOUT) {}
 
 HttpClient::~HttpClient() = default;
 
@@ -23,38 +67,166 @@ const char* HttpClient::InternalServerErrorException::what() const noexcept {
     return message.c_str();
 }
 
+HttpClient::TimeoutException::TimeoutException(const std::string& stage)
+    : message(fmt::format("TimeoutException: {}", stage)) {}
+
+const char* HttpClient::TimeoutException::what() const noexcept {
+    return message.c_str();
+}
+
+HttpClient::UnexpectedStatusException::UnexpectedStatusException(http::status status)
+    : status(status), message(fmt::format("UnexpectedStatusException: {}", static_cast<unsigned>(status))) {}
+
+const char* HttpClient::UnexpectedStatusException::what() const noexcept {
+    return message.c_str();
+}
+
+http::status HttpClient::UnexpectedStatusException::getStatus() const {
+    return status;
+}
+
+HttpClient::BodyTooLargeException::BodyTooLargeException(std::uint64_t maxBodySize)
+    : message(fmt::format("BodyTooLargeException: the body is longer than {} bytes", maxBodySize)) {}
+
+const char* HttpClient::BodyTooLargeException::what() const noexcept {
+    return message.c_str();
+}
+
+HttpClient::CancellationScope::CancellationScope(asio::io_context& ioContext) : ioContext(ioContext) {}
+
+HttpClient::CancellationScope::~CancellationScope() = default;
+
+HttpClient::CancellationScope::RunningOperation::RunningOperation(asio::io_context& ioContext)
+    : strand(asio::make_strand(ioContext)) {}
+
+asio::awaitable<HttpClient::Response> HttpClient::CancellationScope::run(asio::awaitable<Response> operation) {
+    auto runningOperation = std::make_shared<RunningOperation>(ioContext);
+    {
+        std::lock_guard guard(runningOperationsMutex);
+        runningOperations.insert(runningOperation);
+    }
+
+    struct Unregister {
+        CancellationScope& scope;
+        const std::shared_ptr<RunningOperation>& runningOperation;
+
+        ~Unregister() {
+            std::lock_guard guard(scope.runningOperationsMutex);
+            scope.runningOperations.erase(runningOperation);
+        }
+    } unregister{*this, runningOperation};
+
+    // The operation runs on a strand, so that the cancellation signal is never emitted concurrently with it.
+    co_return co_await asio::co_spawn(
+        runningOperation->strand,
+        std::move(operation),
+        asio::bind_cancellation_slot(runningOperation->signal.slot(), asio::use_awaitable)
+    );
+}
+
+void HttpClient::CancellationScope::cancel() {
+    std::lock_guard guard(runningOperationsMutex);
+    for (const auto& runningOperation : runningOperations) {
+        asio::post(runningOperation->strand, [runningOperation] {
+            runningOperation->signal.emit(asio::cancellation_type::terminal);
+        });
+    }
+}
+
+// Awaitable operators wait for the first operation to succeed, so a failed operation would only end a race with
+// a timer once the timer runs out. Catching its exception lets the operation end the race either way.
+template <typename T>
+static asio::awaitable<std::variant<T, std::exception_ptr>> catchException(asio::awaitable<T> operation) {
+    try {
+        co_return co_await std::move(operation);
+    } catch (...) {
+        co_return std::current_exception();
+    }
+}
+
+static asio::awaitable<std::exception_ptr> catchException(asio::awaitable<void> operation) {
+    try {
+        co_await std::move(operation);
+        co_return nullptr;
+    } catch (...) {
+        co_return std::current_exception();
+    }
+}
+
+// Runs the operation, cancelling it through its cancellation slot if it's not done by the deadline. Errors of the
+// operation itself are rethrown as soon as they happen.
+template <typename T>
+static asio::awaitable<T> withDeadline(
+    asio::awaitable<T> operation,
+    std::chrono::steady_clock::time_point deadline,
+    const char* stage
+) {
+    asio::steady_timer timer{co_await asio::this_coro::executor, deadline};
+    std::variant<std::variant<T, std::exception_ptr>, std::monostate> result =
+        co_await (catchException(std::move(operation)) || timer.async_wait(asio::use_awaitable));
+    if (result.index() == 1) {
+        throw HttpClient::TimeoutException(stage);
+    }
+    std::variant<T, std::exception_ptr>& outcome = std::get<0>(result);
+    if (outcome.index() == 1) {
+        std::rethrow_exception(std::get<1>(outcome));
+    }
+    co_return std::get<0>(std::move(outcome));
+}
+
+static asio::awaitable<void> withDeadline(
+    asio::awaitable<void> operation,
+    std::chrono::steady_clock::time_point deadline,
+    const char* stage
+) {
+    asio::steady_timer timer{co_await asio::this_coro::executor, deadline};
+    std::variant<std::exception_ptr, std::monostate> result =
+        co_await (catchException(std::move(operation)) || timer.async_wait(asio::use_awaitable));
+    if (result.index() == 1) {
+        throw HttpClient::TimeoutException(stage);
+    }
+    if (std::get<0>(result)) {
+        std::rethrow_exception(std::get<0>(result));
+    }
+}
+
+// The name of the endpoint for the metrics: the host and the path without the query.
+static std::string getEndpointName(std::string_view host, std::string_view path) {
+    return fmt::format("{}{}", host, path.substr(0, path.find('?')));
+}
+
+static http::request<http::string_body> makeRequest(
+    std::string_view host,
+    std::string_view target,
+    http::verb method,
+    const json::value& body
+) {
+    http::request<http::string_body> request{method, target, 11};
+    request.set(http::field::host, host);
+    if (!body.is_null()) {
+        request.body() = serialize(body);
+        request.prepare_payload();
+        request.set(http::field::content_type, "application/json");
+    }
+    return request;
+}
+
 asio::awaitable<HttpClient::Response> HttpClient::request(
     const std::string& host,
     const std::string& path,
     const std::map<std::string, std::string>& headers,
     std::initializer_list<boost::urls::param_view> urlParams,
     http::verb method,
-    json::value requestBody
+    json::value requestBody,
+    json::storage_ptr storage
 ) {
-    ssl::stream<asio::ip::tcp::socket> stream = co_await resolveHost(host);
     boost::urls::url pathWithParams = boost::urls::parse_origin_form(path).value();
     pathWithParams.set_params(urlParams);
-    http::request<http::string_body> request{method, pathWithParams.buffer(), 11};
-    request.set(http::field::host, host);
+    http::request<http::string_body> request = makeRequest(host, pathWithParams.buffer(), method, requestBody);
     for (const auto& [headerName, headerValue] : headers) {
         request.set(headerName, headerValue);
     }
-    if (!requestBody.is_null()) {
-        request.body() = serialize(requestBody);
-        request.prepare_payload();
-        request.set(http::field::content_type, "application/json");
-    }
-
-    http::response<http::dynamic_body> response = co_await getResponse(request, stream);
-    std::string body = boost::beast::buffers_to_string(response.body().data());
-    if (response.result() == http::status::internal_server_error) {
-        throw HttpClient::InternalServerErrorException(body);
-    }
-    json::value responseJson;
-    if (!body.empty()) {
-        responseJson = boost::json::parse(body);
-    }
-    co_return HttpClient::Response{response.result(), std::move(responseJson)};
+    co_return co_await sendRequest(host, getEndpointName(host, path), request, storage);
 }
 
 asio::awaitable<HttpClient::Response> HttpClient::request(
@@ -64,10 +236,17 @@ asio::awaitable<HttpClient::Response> HttpClient::request(
     const std::string& clientId,
     std::initializer_list<boost::urls::param_view> urlParams,
     http::verb method,
-    json::value body
+    json::value body,
+    json::storage_ptr storage
 ) {
-    std::map<std::string, std::string> headers{{"Authorization", "Bearer " + accessToken}, {"Client-Id", clientId}};
-    co_return co_await request(host, path, headers, urlParams, method, body);
+    boost::urls::url pathWithParams = boost::urls::parse_origin_form(path).value();
+    pathWithParams.set_params(urlParams);
+    http::request<http::string_body> request = makeRequest(host, pathWithParams.buffer(), method, body);
+    HttpHeaderBuilder headers;
+    headers.add("Authorization", "Bearer ", accessToken);
+    headers.add("Client-Id", clientId);
+    headers.applyTo(request);
+    co_return co_await sendRequest(host, getEndpointName(host, path), request, storage);
 }
 
 asio::awaitable<HttpClient::Response> HttpClient::request(
@@ -76,10 +255,111 @@ asio::awaitable<HttpClient::Response> HttpClient::request(
     TwitchAuth& auth,
     std::initializer_list<boost::urls::param_view> urlParams,
     http::verb method,
-    json::value body
+    json::value body,
+    json::storage_ptr storage
+) {
+    boost::urls::url pathWithParams = boost::urls::parse_origin_form(path).value();
+    pathWithParams.set_params(urlParams);
+    http::request<http::string_body> request = makeRequest(host, pathWithParams.buffer(), method, body);
+    HttpHeaderBuilder headers;
+    auth.addAuthorizationHeaders(headers);
+    headers.applyTo(request);
+    co_return co_await sendTwitchRequest(host, getEndpointName(host, path), request, auth, storage);
+}
+
+asio::awaitable<HttpClient::Response> HttpClient::request(
+    const HttpEndpoint& endpoint,
+    TwitchAuth& auth,
+    std::initializer_list<boost::urls::param_view> urlParams,
+    json::value body,
+    json::storage_ptr storage
+) {
+    HttpHeaderBuilder headers;
+    auth.addAuthorizationHeaders(headers);
+    http::request<http::string_body> request = buildRequest(endpoint, headers, urlParams, body);
+    // API hosts are short enough for the small string optimization, so this doesn't allocate.
+    std::string host(endpoint.host);
+    co_return co_await sendTwitchRequest(host, getEndpointName(endpoint.host, endpoint.path), request, auth, storage);
+}
+
+http::request<http::string_body> HttpClient::buildRequest(
+    const HttpEndpoint& endpoint,
+    const HttpHeaderBuilder& headers,
+    std::initializer_list<boost::urls::param_view> urlParams,
+    const json::value& body
+) {
+    boost::urls::static_url<MAX_TARGET_SIZE> target;
+    target.set_encoded_path(endpoint.path);
+    target.set_params(urlParams);
+    http::request<http::string_body> request =
+        makeRequest(endpoint.host, target.encoded_target(), endpoint.method, body);
+    headers.applyTo(request);
+    return request;
+}
+
+asio::awaitable<HttpClient::Response> HttpClient::sendRequest(
+    const std::string& host,
+    const std::string& endpointName,
+    http::request<http::string_body>& request,
+    json::storage_ptr storage
+) {
+    struct RecordTotalLatency {
+        HttpLatencyMetrics::Endpoint& latencyMetrics;
+        std::chrono::steady_clock::time_point start;
+
+        ~RecordTotalLatency() {
+            latencyMetrics.record(HttpLatencyMetrics::Stage::TOTAL, std::chrono::steady_clock::now() - start);
+        }
+    } recordTotalLatency{latencyMetrics.getEndpoint(endpointName), std::chrono::steady_clock::now()};
+
+    retryPolicy.onRequestStarted();
+    for (unsigned attempt = 1;; attempt++) {
+        std::optional<Response> response;
+        std::exception_ptr exception;
+        try {
+            response = co_await getJsonResponse(host, endpointName, request, storage);
+        } catch (const InternalServerErrorException&) {
+            exception = std::current_exception();
+        } catch (const TimeoutException&) {
+            exception = std::current_exception();
+        } catch (const NetworkException& networkException) {
+            if (networkException.code() == asio::error::operation_aborted) {
+                throw;  // Cancelled by a CancellationScope.
+            }
+            exception = std::current_exception();
+        }
+
+        bool failed = exception || HttpRetryPolicy::isRetryableStatus(response->status);
+        if (!failed || !retryPolicy.tryStartRetry(request.method(), attempt)) {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            co_return std::move(response.value());
+        }
+
+        auto backoff = retryPolicy.getBackoff(attempt);
+        log(
+            LOG_WARNING,
+            "Attempt {} of {} {}{} failed, retrying in {} ms",
+            attempt,
+            std::string(request.method_string()),
+            host,
+            std::string(request.target()),
+            backoff.count()
+        );
+        co_await asio::steady_timer(co_await asio::this_coro::executor, backoff).async_wait(asio::use_awaitable);
+    }
+}
+
+asio::awaitable<HttpClient::Response> HttpClient::sendTwitchRequest(
+    const std::string& host,
+    const std::string& endpointName,
+    http::request<http::string_body>& request,
+    TwitchAuth& auth,
+    json::storage_ptr storage
 ) {
     HttpClient::Response response =
-        co_await request(host, path, auth.getAccessTokenOrThrow(), auth.getClientId(), urlParams, method, body);
+        co_await auth.getRequestScope().run(sendRequest(host, endpointName, request, storage));
     if (response.status == http::status::unauthorized) {
         auth.logOutAndEmitAuthenticationFailure();
         throw TwitchAuth::UnauthenticatedException();
@@ -87,46 +367,523 @@ asio::awaitable<HttpClient::Response> HttpClient::request(
     co_return response;
 }
 
-asio::awaitable<std::string> HttpClient::downloadFile(const std::string& host, const std::string& path) {
-    ssl::stream<asio::ip::tcp::socket> stream = co_await resolveHost(host);
+asio::awaitable<HttpClient::Response> HttpClient::getJsonResponse(
+    const std::string& host,
+    const std::string& endpointName,
+    http::request<http::string_body>& request,
+    json::storage_ptr storage
+) {
+    std::unique_ptr<ResponseStream> response = co_await getResponse(host, endpointName, request);
+    http::status status = response->getStatus();
+    http::fields headers = response->getHeader().base();
+    if (http::to_status_class(status) == http::status_class::server_error) {
+        // Server errors often come from proxies and aren't JSON.
+        std::string body;
+        for (std::string_view chunk; !(chunk = co_await response->readChunk()).empty();) {
+            body += chunk;
+        }
+        recordCompressionStats(endpointName, *response);
+        if (status == http::status::internal_server_error) {
+            throw HttpClient::InternalServerErrorException(body);
+        }
+        co_return HttpClient::Response{status, json::string(body, storage), std::move(headers)};
+    }
+
+    json::stream_parser parser(storage);
+    parser.reset(storage);
+    bool bodyEmpty = true;
+    for (std::string_view chunk; !(chunk = co_await response->readChunk()).empty();) {
+        parser.write(chunk.data(), chunk.size());
+        bodyEmpty = false;
+    }
+    recordCompressionStats(endpointName, *response);
+    json::value responseJson;
+    if (!bodyEmpty) {
+        parser.finish();
+        responseJson = parser.release();
+    }
+    co_return HttpClient::Response{status, std::move(responseJson), std::move(headers)};
+}
+
+asio::awaitable<std::uint64_t> HttpClient::downloadFile(
+    const std::string& host,
+    const std::string& path,
+    const DownloadSink& sink,
+    std::uint64_t maxBodySize
+) {
     http::request<http::string_body> request{http::verb::get, path, 11};
     request.set(http::field::host, host);
 
-    http::response<http::dynamic_body> response = co_await getResponse(request, stream);
-    if (response.result() != http::status::ok) {
-        throw TwitchAuth::UnauthenticatedException();
+    std::string endpointName = getEndpointName(host, DOWNLOAD_ENDPOINT_PATH);
+    std::unique_ptr<ResponseStream> response = co_await getResponse(host, endpointName, request);
+    if (response->getStatus() != http::status::ok) {
+        throw UnexpectedStatusException(response->getStatus());
+    }
+    // Without a Content-Encoding, Content-Length is the size of the body, so a too large one is rejected
+    // before reading it. Otherwise, only the decoded size can be checked, as it's received.
+    std::string_view contentLength = response->getHeader()[http::field::content_length];
+    std::uint64_t expectedBodySize = 0;
+    auto parseResult =
+        std::from_chars(contentLength.data(), contentLength.data() + contentLength.size(), expectedBodySize);
+    if (!response->decoder && parseResult.ec == std::errc() && expectedBodySize > maxBodySize) {
+        throw BodyTooLargeException(maxBodySize);
+    }
+
+    std::uint64_t bodySize = 0;
+    for (std::string_view chunk; !(chunk = co_await response->readChunk()).empty();) {
+        bodySize += chunk.size();
+        if (bodySize > maxBodySize) {
+            // The rest of the body is left unread, so the connection is closed instead of being reused.
+            throw BodyTooLargeException(maxBodySize);
+        }
+        sink(chunk);
+    }
+    recordCompressionStats(endpointName, *response);
+    co_return bodySize;
+}
+
+asio::awaitable<std::string> HttpClient::downloadFile(
+    const std::string& host,
+    const std::string& path,
+    std::uint64_t maxBodySize
+) {
+    std::string body;
+    co_await downloadFile(
+        host,
+        path,
+        [&body](std::string_view chunk) {
+            body += chunk;
+        },
+        maxBodySize
+    );
+    co_return body;
+}
+
+std::map<std::string, HttpClient::CompressionStats> HttpClient::getCompressionStats() const {
+    std::lock_guard guard(compressionStatsMutex);
+    return compressionStats;
+}
+
+void HttpClient::recordCompressionStats(const std::string& endpointName, const ResponseStream& response) {
+    std::lock_guard guard(compressionStatsMutex);
+    CompressionStats& stats = compressionStats[endpointName];
+    stats.encodedBytes += response.compressionStats.encodedBytes;
+    stats.decodedBytes += response.compressionStats.decodedBytes;
+}
+
+const HttpLatencyMetrics& HttpClient::getLatencyMetrics() const {
+    return latencyMetrics;
+}
+
+void HttpClient::enableHttp2(const std::string& host) {
+    std::lock_guard guard(http2HostsMutex);
+    http2Hosts.try_emplace(host);
+}
+
+void HttpClient::prewarmConnections(const std::vector<std::string>& hosts, std::function<bool()> isNeeded) {
+    for (const std::string& host : hosts) {
+        asio::co_spawn(ioContext, asyncKeepConnectionWarm(host, isNeeded), asio::detached);
+    }
+}
+
+void HttpClient::resetConnections() {
+    connectionPool.clear();
+    std::lock_guard guard(http2HostsMutex);
+    for (auto& [host, http2Host] : http2Hosts) {
+        if (http2Host.connection) {
+            http2Host.connection->shutdown();
+            http2Host.connection.reset();
+        }
+        // The new network may lead to a different server.
+        http2Host.unsupportedUntil = {};
     }
-    co_return boost::beast::buffers_to_string(response.body().data());
 }
 
-asio::awaitable<ssl::stream<asio::ip::tcp::socket>> HttpClient::resolveHost(const std::string& host) {
-    ssl::context sslContext{ssl::context::tlsv12};
-    sslContext.set_default_verify_paths();
-    asio::ip::tcp::resolver resolver{ioContext};
-    ssl::stream<asio::ip::tcp::socket> stream{ioContext, sslContext};
+asio::awaitable<void> HttpClient::asyncKeepConnectionWarm(std::string host, std::function<bool()> isNeeded) {
+    while (true) {
+        if (isNeeded()) {
+            try {
+                co_await warmUpConnection(host);
+            } catch (const std::exception& exception) {
+                log(LOG_WARNING, "Failed to prewarm the connection to {}: {}", host, exception.what());
+            }
+        }
+        co_await asio::steady_timer(ioContext, PREWARM_CHECK_PERIOD).async_wait(asio::use_awaitable);
+    }
+}
+
+asio::awaitable<void> HttpClient::warmUpConnection(const std::string& host) {
+    HttpLatencyMetrics::Endpoint& endpointLatencyMetrics = latencyMetrics.getEndpoint(host);
+    if (std::shared_ptr<Http2Connection> http2Connection = co_await getHttp2Connection(host, endpointLatencyMetrics)) {
+        http2Connection->ping(HTTP2_PING_ACK_TIMEOUT);
+        co_return;
+    }
+
+    if (connectionPool.hasIdleConnection(host, PREWARM_CHECK_PERIOD)) {
+        // A recent request has left a connection that lasts until the next check.
+        co_return;
+    }
+    HttpConnectionPool::Connection connection = co_await connectionPool.acquire(host);
+    // The idle connection, if any, is about to be evicted, and the server may have closed it by now.
+    connection.resetStream();
+    connection.setStream(co_await resolveHost(host, endpointLatencyMetrics));
+    connection.keepAlive();
+}
+
+HttpClient::ResponseStream::ResponseStream(HttpConnectionPool::Connection connection)
+    : connection(std::move(connection)), http2BodyRead(false), latencyMetrics(nullptr), cachedBodyRead(false),
+      cache(nullptr) {}
+
+HttpClient::ResponseStream::ResponseStream(Http2Connection::Response http2Response)
+    : http2Body(std::move(http2Response.body)), http2BodyRead(false), latencyMetrics(nullptr), cachedBodyRead(false),
+      cache(nullptr) {
+    // Fill in the header of the parser, so that the response looks the same as an HTTP/1.1 one.
+    auto& header = parser.get();
+    header.result(http2Response.status);
+    for (const auto& field : http2Response.headers) {
+        header.insert(field.name_string(), field.value());
+    }
+}
+
+const http::response_parser<http::buffer_body>::value_type& HttpClient::ResponseStream::getHeader() const {
+    return parser.get();
+}
 
-    if (!SSL_set_tlsext_host_name(stream.native_handle(), host.c_str())) {
-        throw boost::system::system_error(
-            boost::system::error_code(static_cast<int>(::ERR_get_error()), asio::error::get_ssl_category()),
-            "Failed to set SNI Hostname"
+http::status HttpClient::ResponseStream::getStatus() const {
+    return cachedEntry ? http::status::ok : getHeader().result();
+}
+
+asio::awaitable<std::string_view> HttpClient::ResponseStream::readChunk() {
+    if (cachedEntry) {
+        // A 304 response has no body, but it still has to be read to the end, so that the connection can be reused.
+        while (!(co_await readDecodedChunk()).empty()) {
+        }
+        if (cachedBodyRead) {
+            co_return std::string_view();
+        }
+        cachedBodyRead = true;
+        co_return std::string_view(cachedEntry->body);
+    }
+
+    std::string_view chunk = co_await readDecodedChunk();
+    if (newCacheEntry) {
+        if (chunk.empty()) {
+            cache->store(cacheKey, std::move(newCacheEntry.value()));
+            newCacheEntry.reset();
+        } else if (newCacheEntry->body.size() + chunk.size() > HttpCache::MAX_ENTRY_SIZE) {
+            newCacheEntry.reset();
+        } else {
+            newCacheEntry->body += chunk;
+        }
+    }
+    co_return chunk;
+}
+
+void HttpClient::ResponseStream::startCaching(
+    HttpCache& cache,
+    std::string key,
+    std::shared_ptr<const HttpCache::Entry> cachedEntry
+) {
+    http::status status = getHeader().result();
+    if (status == http::status::not_modified && cachedEntry) {
+        this->cachedEntry = std::move(cachedEntry);
+    } else if (status == http::status::ok) {
+        newCacheEntry = HttpCache::getValidators(getHeader());
+        this->cache = &cache;
+        cacheKey = std::move(key);
+    }
+}
+
+asio::awaitable<std::string_view> HttpClient::ResponseStream::readDecodedChunk() {
+    while (true) {
+        if (decoder) {
+            std::string_view decodedChunk = decoder->decode();
+            if (!decodedChunk.empty()) {
+                compressionStats.decodedBytes += decodedChunk.size();
+                co_return decodedChunk;
+            }
+        }
+
+        std::string_view encodedChunk = co_await readEncodedChunk();
+        compressionStats.encodedBytes += encodedChunk.size();
+        if (!decoder) {
+            compressionStats.decodedBytes += encodedChunk.size();
+            co_return encodedChunk;
+        }
+        if (encodedChunk.empty()) {
+            if (!decoder->isDone() && compressionStats.encodedBytes > 0) {
+                throw ContentDecoder::DecodingException("The compressed body is truncated");
+            }
+            co_return encodedChunk;
+        }
+        decoder->setInput(encodedChunk);
+    }
+}
+
+void HttpClient::ResponseStream::startDecoding() {
+    std::string_view contentEncoding = getHeader()[http::field::content_encoding];
+    if (contentEncoding.empty()) {
+        return;
+    }
+    if (auto encoding = ContentDecoder::parseEncoding(contentEncoding)) {
+        decoder = std::make_unique<ContentDecoder>(encoding.value());
+    } else {
+        log(LOG_WARNING, "Unsupported Content-Encoding: {}", std::string(contentEncoding));
+    }
+}
+
+asio::awaitable<std::string_view> HttpClient::ResponseStream::readEncodedChunk() {
+    if (http2Body) {
+        recordBodyRead();
+        std::string_view body = http2BodyRead ? std::string_view() : std::string_view(http2Body.value());
+        http2BodyRead = true;
+        co_return body;
+    }
+
+    std::size_t bytesRead = 0;
+    while (bytesRead == 0 && !parser.is_done()) {
+        http::buffer_body::value_type& body = parser.get().body();
+        body.data = chunk.data();
+        body.size = chunk.size();
+        boost::system::error_code ec;
+        co_await withDeadline(
+            http::async_read(connection->getStream(), buffer, parser, asio::redirect_error(asio::use_awaitable, ec)),
+            readDeadline,
+            "read"
+        );
+        if (ec && ec != http::error::need_buffer) {
+            throw NetworkException(ec);
+        }
+        bytesRead = chunk.size() - body.size;
+    }
+    if (parser.is_done()) {
+        recordBodyRead();
+    }
+    if (parser.is_done() && parser.keep_alive()) {
+        connection->keepAlive();
+    }
+    co_return std::string_view(chunk.data(), bytesRead);
+}
+
+void HttpClient::ResponseStream::recordBodyRead() {
+    if (latencyMetrics) {
+        latencyMetrics->record(HttpLatencyMetrics::Stage::BODY_READ, std::chrono::steady_clock::now() - bodyReadStart);
+        latencyMetrics = nullptr;
+    }
+}
+
+asio::awaitable<std::unique_ptr<HttpConnectionPool::Stream>> HttpClient::resolveHost(
+    const std::string& host,
+    HttpLatencyMetrics::Endpoint& latencyMetrics,
+    bool offerHttp2
+) {
+    auto stream = std::make_unique<HttpConnectionPool::Stream>(ioContext, *tlsContext.get());
+
+    tlsContext.prepareHandshake(stream->native_handle(), host);
+    if (offerHttp2) {
+        const std::string_view& protocols = Http2Connection::ALPN_PROTOCOLS;
+        SSL_set_alpn_protos(
+            stream->native_handle(), reinterpret_cast<const unsigned char*>(protocols.data()), protocols.size()
         );
     }
 
-    const auto resolveResults = co_await resolver.async_resolve(host, "https", asio::use_awaitable);
-    co_await asio::async_connect(
-        stream.next_layer(), resolveResults.begin(), resolveResults.end(), asio::use_awaitable
+    auto stageStart = std::chrono::steady_clock::now();
+    auto connectDeadline = stageStart + timeouts.connect;
+    const auto resolveResults = co_await withDeadline(dnsCache.resolve(host, "https"), connectDeadline, "resolve");
+    auto stageEnd = std::chrono::steady_clock::now();
+    latencyMetrics.record(HttpLatencyMetrics::Stage::DNS, stageEnd - stageStart);
+
+    stageStart = stageEnd;
+    co_await withDeadline(
+        happyEyeballsConnector.connect(stream->next_layer(), host, resolveResults),
+        connectDeadline,
+        "connect"
+    );
+    stageEnd = std::chrono::steady_clock::now();
+    latencyMetrics.record(HttpLatencyMetrics::Stage::CONNECT, stageEnd - stageStart);
+
+    stageStart = stageEnd;
+    co_await withDeadline(
+        stream->async_handshake(ssl::stream_base::client, asio::use_awaitable),
+        stageStart + timeouts.tlsHandshake,
+        "TLS handshake"
     );
-    co_await stream.async_handshake(ssl::stream_base::client, asio::use_awaitable);
+    latencyMetrics.record(HttpLatencyMetrics::Stage::TLS_HANDSHAKE, std::chrono::steady_clock::now() - stageStart);
+    tlsContext.onHandshakeCompleted(stream->native_handle());
     co_return stream;
 }
 
-asio::awaitable<http::response<http::dynamic_body>> HttpClient::getResponse(
-    const http::request<http::string_body>& request,
-    ssl::stream<asio::ip::tcp::socket>& stream
+asio::awaitable<std::unique_ptr<HttpClient::ResponseStream>> HttpClient::getResponse(
+    const std::string& host,
+    const std::string& endpointName,
+    http::request<http::string_body>& request
 ) {
-    co_await http::async_write(stream, request, asio::use_awaitable);
-    boost::beast::flat_buffer buffer;
-    http::response<http::dynamic_body> response;
-    co_await http::async_read(stream, buffer, response, asio::use_awaitable);
+    request.keep_alive(true);
+    request.set(http::field::accept_encoding, "gzip, deflate");
+    HttpLatencyMetrics::Endpoint& endpointLatencyMetrics = latencyMetrics.getEndpoint(endpointName);
+    std::string cacheKey = host + std::string(request.target());
+    std::shared_ptr<const HttpCache::Entry> cachedEntry;
+    if (request.method() == http::verb::get) {
+        cachedEntry = co_await httpCache.asyncFind(cacheKey);
+    }
+    HttpCache::setValidators(request, cachedEntry.get());
+
+    std::unique_ptr<ResponseStream> response;
+    if (std::shared_ptr<Http2Connection> http2Connection = co_await getHttp2Connection(host, endpointLatencyMetrics)) {
+        auto requestStart = std::chrono::steady_clock::now();
+        try {
+            response = std::make_unique<ResponseStream>(co_await withDeadline(
+                http2Connection->request(host, request), requestStart + timeouts.write + timeouts.read, "HTTP/2 request"
+            ));
+        } catch (const TimeoutException&) {
+            dropHttp2Connection(host, http2Connection);
+            throw;
+        } catch (const NetworkException& networkException) {
+            if (networkException.code() != asio::error::operation_aborted) {
+                dropHttp2Connection(host, http2Connection);
+            }
+            throw;
+        }
+        response->bodyReadStart = std::chrono::steady_clock::now();
+        endpointLatencyMetrics.record(
+            HttpLatencyMetrics::Stage::TIME_TO_FIRST_BYTE, response->bodyReadStart - requestStart
+        );
+    } else {
+        response = co_await getHttp1Response(host, request, endpointLatencyMetrics);
+    }
+
+    response->latencyMetrics = &endpointLatencyMetrics;
+    response->startDecoding();
+    if (request.method() == http::verb::get) {
+        response->startCaching(httpCache, std::move(cacheKey), std::move(cachedEntry));
+    }
     co_return response;
 }
+
+asio::awaitable<std::unique_ptr<HttpClient::ResponseStream>> HttpClient::getHttp1Response(
+    const std::string& host,
+    http::request<http::string_body>& request,
+    HttpLatencyMetrics::Endpoint& latencyMetrics
+) {
+    auto response = std::make_unique<ResponseStream>(co_await connectionPool.acquire(host));
+    while (true) {
+        HttpConnectionPool::Connection& connection = response->connection.value();
+        if (!connection.hasStream()) {
+            connection.setStream(co_await resolveHost(host, latencyMetrics));
+        }
+
+        bool staleConnection = false;
+        auto writeStart = std::chrono::steady_clock::now();
+        try {
+            boost::system::error_code writeError;
+            std::size_t bytesWritten = co_await withDeadline(
+                http::async_write(
+                    connection.getStream(), request, asio::redirect_error(asio::use_awaitable, writeError)
+                ),
+                writeStart + timeouts.write,
+                "write"
+            );
+            if (writeError) {
+                // Nothing has reached the server, so the request can't have been processed.
+                if (bytesWritten == 0 && connection.isReused()) {
+                    staleConnection = true;
+                } else {
+                    throw NetworkException(writeError);
+                }
+            } else {
+                response->readDeadline = std::chrono::steady_clock::now() + timeouts.read;
+                co_await withDeadline(
+                    http::async_read_header(
+                        connection.getStream(), response->buffer, response->parser, asio::use_awaitable
+                    ),
+                    response->readDeadline,
+                    "read"
+                );
+            }
+        } catch (const NetworkException&) {
+            // The server has probably closed the idle connection in the meantime. It may have processed the request
+            // nonetheless, so only the requests that are safe to repeat are retried on a new connection.
+            if (!connection.isReused() || !HttpRetryPolicy::isIdempotent(request.method())) {
+                throw;
+            }
+            staleConnection = true;
+        }
+
+        if (staleConnection) {
+            connection.resetStream();
+            // Start over with a new parser, as the failed one may have consumed a part of the response.
+            response = std::make_unique<ResponseStream>(std::move(connection));
+            continue;
+        }
+        response->bodyReadStart = std::chrono::steady_clock::now();
+        latencyMetrics.record(HttpLatencyMetrics::Stage::TIME_TO_FIRST_BYTE, response->bodyReadStart - writeStart);
+        co_return response;
+    }
+}
+
+asio::awaitable<std::shared_ptr<Http2Connection>> HttpClient::getHttp2Connection(
+    const std::string& host,
+    HttpLatencyMetrics::Endpoint& latencyMetrics
+) {
+    while (true) {
+        {
+            std::lock_guard guard(http2HostsMutex);
+            auto it = http2Hosts.find(host);
+            if (it == http2Hosts.end() || std::chrono::steady_clock::now() < it->second.unsupportedUntil) {
+                co_return nullptr;
+            }
+            Http2Host& http2Host = it->second;
+            if (http2Host.connection && http2Host.connection->isOpen()) {
+                co_return http2Host.connection;
+            }
+            if (!http2Host.connecting) {
+                http2Host.connecting = true;
+                break;
+            }
+        }
+        co_await asio::steady_timer(co_await asio::this_coro::executor, HTTP2_CONNECT_RECHECK_PERIOD)
+            .async_wait(asio::use_awaitable);
+    }
+
+    std::unique_ptr<HttpConnectionPool::Stream> stream;
+    std::exception_ptr exception;
+    try {
+        stream = co_await resolveHost(host, latencyMetrics, true);
+    } catch (...) {
+        exception = std::current_exception();
+    }
+
+    bool negotiated = exception == nullptr && Http2Connection::isNegotiated(stream->native_handle());
+    {
+        std::lock_guard guard(http2HostsMutex);
+        Http2Host& http2Host = http2Hosts[host];
+        http2Host.connecting = false;
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        if (negotiated) {
+            http2Host.connection = std::make_shared<Http2Connection>(std::move(stream));
+            http2Host.connection->start();
+            co_return http2Host.connection;
+        }
+        log(LOG_INFO, "{} doesn't support HTTP/2, falling back to HTTP/1.1", host);
+        http2Host.unsupportedUntil = std::chrono::steady_clock::now() + HTTP2_UNSUPPORTED_RECHECK_PERIOD;
+    }
+
+    // The TLS stream is fine for HTTP/1.1, so let the request that follows reuse it.
+    HttpConnectionPool::Connection connection = co_await connectionPool.acquire(host);
+    if (!connection.hasStream()) {
+        connection.setStream(std::move(stream));
+        connection.keepAlive();
+    }
+    co_return nullptr;
+}
+
+void HttpClient::dropHttp2Connection(const std::string& host, const std::shared_ptr<Http2Connection>& connection) {
+    connection->shutdown();
+    std::lock_guard guard(http2HostsMutex);
+    auto it = http2Hosts.find(host);
+    if (it != http2Hosts.end() && it->second.connection == connection) {
+        it->second.connection.reset();
+    }
+}
@@ -3,24 +3,79 @@
 
 #pragma once
 
+#include <array>
 #include <boost/json.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/url.hpp>
+#include <chrono>
+#include <cstdint>
 #include <exception>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <vector>
 
 #include "BoostAsio.h"
+#include "ContentDecoder.h"
+#include "DnsCache.h"
+#include "HappyEyeballsConnector.h"
+#include "Http2Connection.h"
+#include "HttpCache.h"
+#include "HttpConnectionPool.h"
+#include "HttpEndpoint.h"
+#include "HttpLatencyMetrics.h"
+#include "HttpRetryPolicy.h"
+#include "TlsContext.h"
 
+class HttpHeaderBuilder;
 class TwitchAuth;
 
 class HttpClient {
 public:
-    HttpClient(boost::asio::io_context& ioContext);
+    /// How long each stage of a request may take. If a stage takes longer, the request fails with TimeoutException.
+    struct Timeouts {
+        /// Resolving the host and establishing the TCP connection.
+        std::chrono::steady_clock::duration connect;
+        std::chrono::steady_clock::duration tlsHandshake;
+        std::chrono::steady_clock::duration write;
+        /// Reading the whole response, from the header to the end of the body.
+        std::chrono::steady_clock::duration read;
+    };
+    static const Timeouts DEFAULT_TIMEOUTS;
+
+    HttpClient(
+        boost::asio::io_context& ioContext,
+        TlsContext& tlsContext,
+        DnsCache& dnsCache,
+        HappyEyeballsConnector& happyEyeballsConnector,
+        HttpCache& httpCache,
+        const Timeouts& timeouts = DEFAULT_TIMEOUTS,
+        const HttpRetryPolicy::Config& retryConfig = HttpRetryPolicy::DEFAULT_CONFIG
+    );
     ~HttpClient();
 
     struct Response {
         boost::beast::http::status status;
         boost::json::value json;
+        boost::beast::http::fields headers;
+    };
+
+    // The arena for the JSON of a typed response. Small responses fit into the initial buffer,
+    // bigger ones grow the arena by a few large blocks.
+    using TypedResponseArenaBuffer = std::array<unsigned char, 16384>;
+
+    /// A response with the body converted with boost::json::value_to<T>.
+    /// The JSON itself is only kept if the status isn't successful, so that the error can be reported.
+    template <typename T>
+    struct TypedResponse {
+        boost::beast::http::status status;
+        std::optional<T> value;
+        boost::json::value json;
+        boost::beast::http::fields headers;
     };
 
     using NetworkException = boost::system::system_error;
@@ -34,13 +89,69 @@ public:
         std::string message;
     };
 
+    class TimeoutException : public std::exception {
+    public:
+        TimeoutException(const std::string& stage);
+        const char* what() const noexcept override;
+
+    private:
+        std::string message;
+    };
+
+    class UnexpectedStatusException : public std::exception {
+    public:
+        UnexpectedStatusException(boost::beast::http::status status);
+        const char* what() const noexcept override;
+        boost::beast::http::status getStatus() const;
+
+    private:
+        boost::beast::http::status status;
+        std::string message;
+    };
+
+    class BodyTooLargeException : public std::exception {
+    public:
+        BodyTooLargeException(std::uint64_t maxBodySize);
+        const char* what() const noexcept override;
+
+    private:
+        std::string message;
+    };
+
+    /// Requests run in a scope can be cancelled all at once, e.g. the requests of a user who has logged out.
+    /// Cancellation is delivered through asio cancellation slots, so a cancelled request fails with operation_aborted.
+    class CancellationScope {
+    public:
+        CancellationScope(boost::asio::io_context& ioContext);
+        ~CancellationScope();
+
+        boost::asio::awaitable<Response> run(boost::asio::awaitable<Response> operation);
+        /// Cancels the requests running at the moment. Thread-safe.
+        void cancel();
+
+    private:
+        struct RunningOperation {
+            RunningOperation(boost::asio::io_context& ioContext);
+
+            boost::asio::strand<boost::asio::io_context::executor_type> strand;
+            boost::asio::cancellation_signal signal;
+        };
+
+        boost::asio::io_context& ioContext;
+        std::set<std::shared_ptr<RunningOperation>> runningOperations;
+        std::mutex runningOperationsMutex;
+    };
+
+    // The response JSON is allocated from the storage, the default one if it's not set.
+    // Idempotent requests that fail with a network error or a server error are retried according to HttpRetryPolicy.
     boost::asio::awaitable<Response> request(
         const std::string& host,
         const std::string& path,
         const std::map<std::string, std::string>& headers = {},
         std::initializer_list<boost::urls::param_view> urlParams = {},
         boost::beast::http::verb method = boost::beast::http::verb::get,
-        boost::json::value body = {}
+        boost::json::value body = {},
+        boost::json::storage_ptr storage = {}
     );
 
     boost::asio::awaitable<Response> request(
@@ -50,10 +161,24 @@ public:
         const std::string& clientId,
         std::initializer_list<boost::urls::param_view> urlParams = {},
         boost::beast::http::verb method = boost::beast::http::verb::get,
-        boost::json::value body = {}
+        boost::json::value body = {},
+        boost::json::storage_ptr storage = {}
     );
 
     boost::asio::awaitable<Response> request(
+        const std::string& host,
+        const std::string& path,
+        TwitchAuth& auth,
+        std::initializer_list<boost::urls::param_view> urlParams = {},
+        boost::beast::http::verb method = boost::beast::http::verb::get,
+        boost::json::value body = {},
+        boost::json::storage_ptr storage = {}
+    );
+
+    /// The body is parsed into a per-request arena as it arrives and then converted to T with a tag_invoke overload,
+    /// so that no long-lived JSON tree has to be allocated.
+    template <typename T>
+    boost::asio::awaitable<TypedResponse<T>> request(
         const std::string& host,
         const std::string& path,
         TwitchAuth& auth,
@@ -62,14 +187,236 @@ public:
         boost::json::value body = {}
     );
 
-    boost::asio::awaitable<std::string> downloadFile(const std::string& host, const std::string& path);
+    /// Sends a request to the endpoint on behalf of the Twitch user. See buildRequest() for the allocations.
+    boost::asio::awaitable<Response> request(
+        const HttpEndpoint& endpoint,
+        TwitchAuth& auth,
+        std::initializer_list<boost::urls::param_view> urlParams = {},
+        boost::json::value body = {},
+        boost::json::storage_ptr storage = {}
+    );
+
+    template <typename T>
+    boost::asio::awaitable<TypedResponse<T>> request(
+        const HttpEndpoint& endpoint,
+        TwitchAuth& auth,
+        std::initializer_list<boost::urls::param_view> urlParams = {},
+        boost::json::value body = {}
+    );
+
+    /// Builds the request to the endpoint. The target and the header values are composed in fixed-capacity buffers
+    /// instead of temporary strings, so the only allocations are the body and Beast's storage for the start line and
+    /// for each header field. bench/RequestBuildingBenchmark.cpp counts them.
+    static boost::beast::http::request<boost::beast::http::string_body> buildRequest(
+        const HttpEndpoint& endpoint,
+        const HttpHeaderBuilder& headers,
+        std::initializer_list<boost::urls::param_view> urlParams,
+        const boost::json::value& body
+    );
+
+    /// Receives a downloaded body chunk by chunk, e.g. to write it into a file or to feed it to a hash.
+    using DownloadSink = std::function<void(std::string_view chunk)>;
+    static constexpr std::uint64_t DEFAULT_MAX_DOWNLOAD_SIZE = 16 * 1024 * 1024;
+
+    /// Passes the decoded body to the sink as it arrives, so that memory use doesn't depend on the size of the file.
+    /// Throws UnexpectedStatusException if the status isn't 200 and BodyTooLargeException as soon as the body turns
+    /// out to be longer than maxBodySize. Returns the size of the body.
+    boost::asio::awaitable<std::uint64_t> downloadFile(
+        const std::string& host,
+        const std::string& path,
+        const DownloadSink& sink,
+        std::uint64_t maxBodySize = DEFAULT_MAX_DOWNLOAD_SIZE
+    );
+
+    /// Downloads the whole body into a string. Throws the same exceptions as the streaming overload.
+    boost::asio::awaitable<std::string> downloadFile(
+        const std::string& host,
+        const std::string& path,
+        std::uint64_t maxBodySize = DEFAULT_MAX_DOWNLOAD_SIZE
+    );
+
+    /// The size of the response bodies as received and after decoding the Content-Encoding.
+    struct CompressionStats {
+        std::uint64_t encodedBytes = 0;
+        std::uint64_t decodedBytes = 0;
+    };
+    /// The stats per endpoint, keyed by the host and the path without the query.
+    std::map<std::string, CompressionStats> getCompressionStats() const;
+
+    const HttpLatencyMetrics& getLatencyMetrics() const;
+
+    /// Sends the requests to the host over HTTP/2 if the server supports it, so that concurrent requests share
+    /// one connection. Otherwise, HTTP/1.1 keep-alive connections are used as for the other hosts.
+    void enableHttp2(const std::string& host);
+
+    /// Opens connections to the hosts in the background and keeps refreshing them, so that the first request
+    /// to a host, e.g. after startup or after a long idle period, doesn't wait for DNS, TCP and TLS. A connection
+    /// is only replaced when it's about to be evicted as idle, and nothing is done while isNeeded returns false,
+    /// e.g. while no user is logged in.
+    void prewarmConnections(const std::vector<std::string>& hosts, std::function<bool()> isNeeded);
+
+    /// Closes the idle HTTP/1.1 connections and the HTTP/2 ones, e.g. when the network has changed, so that the next
+    /// requests connect again rather than wait for the dead connections to time out.
+    void resetConnections();
 
 private:
-    boost::asio::awaitable<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> resolveHost(const std::string& host);
-    boost::asio::awaitable<boost::beast::http::response<boost::beast::http::dynamic_body>> getResponse(
-        const boost::beast::http::request<boost::beast::http::string_body>& request,
-        boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& stream
+    /// Reads the body of a response chunk by chunk, without buffering the whole body in memory.
+    /// A gzip or deflate body is decoded on the fly. A 304 Not Modified response is replaced with the cached body.
+    class ResponseStream {
+    public:
+        ResponseStream(HttpConnectionPool::Connection connection);
+        /// Wraps a response that has been received over HTTP/2.
+        ResponseStream(Http2Connection::Response http2Response);
+
+        const boost::beast::http::response_parser<boost::beast::http::buffer_body>::value_type& getHeader() const;
+        /// The status of the response, or 200 OK if the response is served from the cache.
+        boost::beast::http::status getStatus() const;
+        /// Returns an empty view once the body has been read. The view is valid until the next call.
+        boost::asio::awaitable<std::string_view> readChunk();
+
+    private:
+        friend class HttpClient;
+
+        /// Sets up the decoder according to Content-Encoding. Call after the header has been read.
+        void startDecoding();
+        /// Serves the cached entry on 304, or saves the body into the cache once it's read if it can be cached.
+        /// Call after the header has been read.
+        void startCaching(HttpCache& cache, std::string key, std::shared_ptr<const HttpCache::Entry> cachedEntry);
+        boost::asio::awaitable<std::string_view> readDecodedChunk();
+        boost::asio::awaitable<std::string_view> readEncodedChunk();
+        void recordBodyRead();
+
+        /// Empty for an HTTP/2 response.
+        std::optional<HttpConnectionPool::Connection> connection;
+        /// The body of an HTTP/2 response, which is received as a whole.
+        std::optional<std::string> http2Body;
+        bool http2BodyRead;
+        boost::beast::flat_buffer buffer;
+        boost::beast::http::response_parser<boost::beast::http::buffer_body> parser;
+        std::array<char, 16384> chunk;
+        std::chrono::steady_clock::time_point readDeadline;
+        std::unique_ptr<ContentDecoder> decoder;
+        CompressionStats compressionStats;
+        HttpLatencyMetrics::Endpoint* latencyMetrics;
+        std::chrono::steady_clock::time_point bodyReadStart;
+        std::shared_ptr<const HttpCache::Entry> cachedEntry;
+        bool cachedBodyRead;
+        HttpCache* cache;
+        std::string cacheKey;
+        /// The entry that's being filled with the body, to be saved into the cache.
+        std::optional<HttpCache::Entry> newCacheEntry;
+    };
+
+    struct Http2Host {
+        std::shared_ptr<Http2Connection> connection;
+        bool connecting = false;
+        /// The server hasn't chosen HTTP/2 during the handshake, so use HTTP/1.1 until then.
+        std::chrono::steady_clock::time_point unsupportedUntil;
+    };
+
+    boost::asio::awaitable<std::unique_ptr<HttpConnectionPool::Stream>> resolveHost(
+        const std::string& host,
+        HttpLatencyMetrics::Endpoint& latencyMetrics,
+        bool offerHttp2 = false
+    );
+    boost::asio::awaitable<void> asyncKeepConnectionWarm(std::string host, std::function<bool()> isNeeded);
+    boost::asio::awaitable<void> warmUpConnection(const std::string& host);
+    /// Returns nullptr if HTTP/2 isn't enabled for the host or isn't supported by the server.
+    boost::asio::awaitable<std::shared_ptr<Http2Connection>> getHttp2Connection(
+        const std::string& host,
+        HttpLatencyMetrics::Endpoint& latencyMetrics
     );
+    /// Shuts the connection down and forgets it, unless it has already been replaced, so that the next request
+    /// connects anew instead of waiting on a dead connection.
+    void dropHttp2Connection(const std::string& host, const std::shared_ptr<Http2Connection>& connection);
+    /// Converts the response, copying the JSON out of the arena if the status isn't successful.
+    template <typename T>
+    static TypedResponse<T> toTypedResponse(Response response);
+
+    /// The endpoint name labels the latency metrics and the compression stats. It's made of the host and the path
+    /// template rather than the actual target, so that the number of the labels stays bounded.
+    boost::asio::awaitable<Response> sendRequest(
+        const std::string& host,
+        const std::string& endpointName,
+        boost::beast::http::request<boost::beast::http::string_body>& request,
+        boost::json::storage_ptr storage
+    );
+    /// Logs the user out if the access token has been rejected.
+    boost::asio::awaitable<Response> sendTwitchRequest(
+        const std::string& host,
+        const std::string& endpointName,
+        boost::beast::http::request<boost::beast::http::string_body>& request,
+        TwitchAuth& auth,
+        boost::json::storage_ptr storage
+    );
+    boost::asio::awaitable<Response> getJsonResponse(
+        const std::string& host,
+        const std::string& endpointName,
+        boost::beast::http::request<boost::beast::http::string_body>& request,
+        boost::json::storage_ptr storage
+    );
+    /// Sends the request and reads the response header.
+    boost::asio::awaitable<std::unique_ptr<ResponseStream>> getResponse(
+        const std::string& host,
+        const std::string& endpointName,
+        boost::beast::http::request<boost::beast::http::string_body>& request
+    );
+    boost::asio::awaitable<std::unique_ptr<ResponseStream>> getHttp1Response(
+        const std::string& host,
+        boost::beast::http::request<boost::beast::http::string_body>& request,
+        HttpLatencyMetrics::Endpoint& latencyMetrics
+    );
+    void recordCompressionStats(const std::string& endpointName, const ResponseStream& response);
 
     boost::asio::io_context& ioContext;
+    TlsContext& tlsContext;
+    DnsCache& dnsCache;
+    HappyEyeballsConnector& happyEyeballsConnector;
+    HttpCache& httpCache;
+    const Timeouts timeouts;
+    HttpRetryPolicy retryPolicy;
+    HttpConnectionPool connectionPool;
+    std::map<std::string, CompressionStats> compressionStats;
+    mutable std::mutex compressionStatsMutex;
+    HttpLatencyMetrics latencyMetrics;
+    std::map<std::string, Http2Host> http2Hosts;
+    std::mutex http2HostsMutex;
 };
+
+template <typename T>
+boost::asio::awaitable<HttpClient::TypedResponse<T>> HttpClient::request(
+    const std::string& host,
+    const std::string& path,
+    TwitchAuth& auth,
+    std::initializer_list<boost::urls::param_view> urlParams,
+    boost::beast::http::verb method,
+    boost::json::value body
+) {
+    TypedResponseArenaBuffer arenaBuffer;
+    boost::json::monotonic_resource arena(arenaBuffer.data(), arenaBuffer.size());
+    co_return toTypedResponse<T>(co_await request(host, path, auth, urlParams, method, std::move(body), &arena));
+}
+
+template <typename T>
+boost::asio::awaitable<HttpClient::TypedResponse<T>> HttpClient::request(
+    const HttpEndpoint& endpoint,
+    TwitchAuth& auth,
+    std::initializer_list<boost::urls::param_view> urlParams,
+    boost::json::value body
+) {
+    TypedResponseArenaBuffer arenaBuffer;
+    boost::json::monotonic_resource arena(arenaBuffer.data(), arenaBuffer.size());
+    co_return toTypedResponse<T>(co_await request(endpoint, auth, urlParams, std::move(body), &arena));
+}
+
+template <typename T>
+HttpClient::TypedResponse<T> HttpClient::toTypedResponse(Response response) {
+    TypedResponse<T> typedResponse{response.status, std::nullopt, nullptr, std::move(response.headers)};
+    if (boost::beast::http::to_status_class(response.status) == boost::beast::http::status_class::successful) {
+        typedResponse.value = boost::json::value_to<T>(response.json);
+    } else {
+        // Copy the JSON out of the arena, as it's about to be destroyed.
+        typedResponse.json = boost::json::value(response.json, boost::json::storage_ptr());
+    }
+    return typedResponse;
+}
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HttpConnectionPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace asio = boost::asio;
+
+HttpConnectionPool::HttpConnectionPool(
+    asio::io_context& ioContext,
+    std::size_t maxConnectionsPerHost,
+    std::chrono::steady_clock::duration idleTimeout
+)
+    : ioContext(ioContext), maxConnectionsPerHost(maxConnectionsPerHost), idleTimeout(idleTimeout) {
+    asio::co_spawn(ioContext, asyncEvictIdleConnectionsPeriodically(), asio::detached);
+}
+
+HttpConnectionPool::~HttpConnectionPool() = default;
+
+HttpConnectionPool::Connection::Connection(HttpConnectionPool& pool, std::string host, std::unique_ptr<Stream> stream)
+    : pool(&pool), host(std::move(host)), stream(std::move(stream)), reused(this->stream != nullptr),
+      shouldKeepAlive(false) {}
+
+HttpConnectionPool::Connection::Connection(Connection&& other) noexcept
+    : pool(std::exchange(other.pool, nullptr)), host(std::move(other.host)), stream(std::move(other.stream)),
+      reused(other.reused), shouldKeepAlive(other.shouldKeepAlive) {}
+
+HttpConnectionPool::Connection::~Connection() {
+    if (pool) {
+        pool->release(host, shouldKeepAlive ? std::move(stream) : nullptr);
+    }
+}
+
+bool HttpConnectionPool::Connection::hasStream() const {
+    return stream != nullptr;
+}
+
+HttpConnectionPool::Stream& HttpConnectionPool::Connection::getStream() {
+    return *stream;
+}
+
+void HttpConnectionPool::Connection::setStream(std::unique_ptr<Stream> newStream) {
+    stream = std::move(newStream);
+    reused = false;
+}
+
+bool HttpConnectionPool::Connection::isReused() const {
+    return reused;
+}
+
+void HttpConnectionPool::Connection::resetStream() {
+    stream = nullptr;
+    reused = false;
+    shouldKeepAlive = false;
+}
+
+void HttpConnectionPool::Connection::keepAlive() {
+    shouldKeepAlive = true;
+}
+
+HttpConnectionPool::Waiter::Waiter(asio::io_context& ioContext) : slotGrantedSignal(ioContext, 1) {}
+
+HttpConnectionPool::WaiterGuard::WaiterGuard(
+    HttpConnectionPool& pool,
+    const std::string& host,
+    std::shared_ptr<Waiter> waiter
+)
+    : pool(pool), host(host), waiter(std::move(waiter)) {}
+
+HttpConnectionPool::WaiterGuard::~WaiterGuard() {
+    if (!waiter) {
+        return;
+    }
+    std::lock_guard guard(pool.connectionsMutex);
+    HostConnections& hostConnections = pool.connections[host];
+    if (waiter->slotGranted) {
+        pool.releaseSlot(hostConnections);
+        return;
+    }
+    auto position = std::find(hostConnections.waiters.begin(), hostConnections.waiters.end(), waiter);
+    if (position != hostConnections.waiters.end()) {
+        hostConnections.waiters.erase(position);
+    }
+}
+
+void HttpConnectionPool::WaiterGuard::dismiss() {
+    waiter = nullptr;
+}
+
+asio::awaitable<HttpConnectionPool::Connection> HttpConnectionPool::acquire(const std::string& host) {
+    std::shared_ptr<Waiter> waiter;
+    {
+        std::lock_guard guard(connectionsMutex);
+        HostConnections& hostConnections = connections[host];
+        if (hostConnections.busyCount < maxConnectionsPerHost) {
+            hostConnections.busyCount++;
+            co_return Connection(*this, host, popIdleStream(hostConnections));
+        }
+        waiter = std::make_shared<Waiter>(ioContext);
+        hostConnections.waiters.push_back(waiter);
+    }
+
+    WaiterGuard waiterGuard(*this, host, waiter);
+    co_await waiter->slotGrantedSignal.async_receive(asio::use_awaitable);
+    std::lock_guard guard(connectionsMutex);
+    waiterGuard.dismiss();
+    // release() has handed its slot over to us, so busyCount is already accounted for.
+    co_return Connection(*this, host, popIdleStream(connections[host]));
+}
+
+bool HttpConnectionPool::hasIdleConnection(
+    const std::string& host,
+    std::chrono::steady_clock::duration minRemainingTime
+) {
+    std::lock_guard guard(connectionsMutex);
+    auto it = connections.find(host);
+    if (it == connections.end() || it->second.idle.empty()) {
+        return false;
+    }
+    auto idleTime = std::chrono::steady_clock::now() - it->second.idle.back().idleSince;
+    return idleTime + minRemainingTime <= idleTimeout;
+}
+
+void HttpConnectionPool::clear() {
+    std::lock_guard guard(connectionsMutex);
+    for (auto& [host, hostConnections] : connections) {
+        hostConnections.idle.clear();
+    }
+}
+
+void HttpConnectionPool::release(const std::string& host, std::unique_ptr<Stream> stream) {
+    std::lock_guard guard(connectionsMutex);
+    HostConnections& hostConnections = connections[host];
+    if (stream) {
+        hostConnections.idle.push_back(IdleConnection{std::move(stream), std::chrono::steady_clock::now()});
+    }
+    releaseSlot(hostConnections);
+}
+
+void HttpConnectionPool::releaseSlot(HostConnections& hostConnections) {
+    if (hostConnections.waiters.empty()) {
+        hostConnections.busyCount--;
+        return;
+    }
+    std::shared_ptr<Waiter> waiter = std::move(hostConnections.waiters.front());
+    hostConnections.waiters.pop_front();
+    waiter->slotGranted = true;
+    waiter->slotGrantedSignal.try_send(boost::system::error_code());
+}
+
+std::unique_ptr<HttpConnectionPool::Stream> HttpConnectionPool::popIdleStream(HostConnections& hostConnections) {
+    evictIdleConnections(hostConnections, std::chrono::steady_clock::now());
+    if (hostConnections.idle.empty()) {
+        return nullptr;
+    }
+    // Take the most recently used connection, as it's the least likely to have been closed by the server.
+    std::unique_ptr<Stream> stream = std::move(hostConnections.idle.back().stream);
+    hostConnections.idle.pop_back();
+    return stream;
+}
+
+void HttpConnectionPool::evictIdleConnections(
+    HostConnections& hostConnections,
+    std::chrono::steady_clock::time_point now
+) {
+    while (!hostConnections.idle.empty() && now - hostConnections.idle.front().idleSince > idleTimeout) {
+        hostConnections.idle.pop_front();
+    }
+}
+
+asio::awaitable<void> HttpConnectionPool::asyncEvictIdleConnectionsPeriodically() {
+    while (true) {
+        co_await asio::steady_timer(ioContext, idleTimeout).async_wait(asio::use_awaitable);
+        std::lock_guard guard(connectionsMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (auto& [host, hostConnections] : connections) {
+            evictIdleConnections(hostConnections, now);
+        }
+    }
+}
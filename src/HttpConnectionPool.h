@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <boost/asio/experimental/concurrent_channel.hpp>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "BoostAsio.h"
+
+/// Keeps idle HTTP/1.1 keep-alive connections per host, so that consecutive requests skip DNS, TCP and TLS setup.
+/// At most maxConnectionsPerHost connections (busy and idle together) exist for a host at any time.
+class HttpConnectionPool {
+public:
+    using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+
+    HttpConnectionPool(
+        boost::asio::io_context& ioContext,
+        std::size_t maxConnectionsPerHost,
+        std::chrono::steady_clock::duration idleTimeout
+    );
+    ~HttpConnectionPool();
+
+    /// A checked out connection slot. Holds a warm stream if an idle one was available, otherwise the caller
+    /// has to connect and call setStream(). The slot is given back to the pool upon destruction.
+    class Connection {
+    public:
+        Connection(Connection&& other) noexcept;
+        Connection& operator=(Connection&&) = delete;
+        ~Connection();
+
+        bool hasStream() const;
+        Stream& getStream();
+        void setStream(std::unique_ptr<Stream> newStream);
+        /// Whether the stream has already been used for another request. Such a stream may have been closed
+        /// by the server in the meantime, hence a failed request on it is worth retrying on a new connection.
+        bool isReused() const;
+        /// Drops the stream, so that the slot can be used for a new connection.
+        void resetStream();
+        /// Return the stream to the idle list instead of closing it once the connection is destroyed.
+        void keepAlive();
+
+    private:
+        friend class HttpConnectionPool;
+        Connection(HttpConnectionPool& pool, std::string host, std::unique_ptr<Stream> stream);
+
+        HttpConnectionPool* pool;
+        std::string host;
+        std::unique_ptr<Stream> stream;
+        bool reused;
+        bool shouldKeepAlive;
+    };
+
+    /// Waits until the host has a free slot and checks it out.
+    boost::asio::awaitable<Connection> acquire(const std::string& host);
+
+    /// Whether the host has an idle connection that won't be evicted for at least minRemainingTime.
+    bool hasIdleConnection(const std::string& host, std::chrono::steady_clock::duration minRemainingTime);
+
+    /// Closes all idle connections, e.g. when the network has changed.
+    void clear();
+
+private:
+    struct IdleConnection {
+        std::unique_ptr<Stream> stream;
+        std::chrono::steady_clock::time_point idleSince;
+    };
+
+    struct Waiter {
+        Waiter(boost::asio::io_context& ioContext);
+
+        /// Receives a message once release() has handed its slot over. Unlike a timer cancellation, the message is
+        /// buffered, so it isn't lost if release() runs on another thread before the wait starts.
+        boost::asio::experimental::concurrent_channel<void(boost::system::error_code)> slotGrantedSignal;
+        bool slotGranted = false;
+    };
+
+    /// Takes the waiter out of the queue if acquire() exits without taking its slot, e.g. on a deadline or
+    /// a cancellation. A slot that has already been granted to it is passed on.
+    class WaiterGuard {
+    public:
+        WaiterGuard(HttpConnectionPool& pool, const std::string& host, std::shared_ptr<Waiter> waiter);
+        WaiterGuard(const WaiterGuard&) = delete;
+        WaiterGuard& operator=(const WaiterGuard&) = delete;
+        ~WaiterGuard();
+
+        /// Call with connectionsMutex locked once the slot has been taken.
+        void dismiss();
+
+    private:
+        HttpConnectionPool& pool;
+        const std::string& host;
+        std::shared_ptr<Waiter> waiter;
+    };
+
+    struct HostConnections {
+        std::deque<IdleConnection> idle;
+        std::size_t busyCount = 0;
+        std::deque<std::shared_ptr<Waiter>> waiters;
+    };
+
+    void release(const std::string& host, std::unique_ptr<Stream> stream);
+    /// Hands the slot over to the next waiter, or frees it if there are none. Call with connectionsMutex locked.
+    void releaseSlot(HostConnections& hostConnections);
+    std::unique_ptr<Stream> popIdleStream(HostConnections& hostConnections);
+    void evictIdleConnections(HostConnections& hostConnections, std::chrono::steady_clock::time_point now);
+    boost::asio::awaitable<void> asyncEvictIdleConnectionsPeriodically();
+
+    boost::asio::io_context& ioContext;
+    const std::size_t maxConnectionsPerHost;
+    const std::chrono::steady_clock::duration idleTimeout;
+    std::map<std::string, HostConnections> connections;
+    std::mutex connectionsMutex;
+};
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+#include "BoostAsio.h"
+
+/// A compile-time description of an API endpoint: where the requests go and which statuses the caller handles.
+struct HttpEndpoint {
+    static constexpr std::size_t MAX_EXPECTED_STATUSES = 4;
+
+    constexpr HttpEndpoint(
+        std::string_view host,
+        std::string_view path,
+        boost::beast::http::verb method,
+        std::initializer_list<boost::beast::http::status> expectedStatuses
+    )
+        : host(host), path(path), method(method), expectedStatuses{}, expectedStatusCount(expectedStatuses.size()) {
+        std::copy(expectedStatuses.begin(), expectedStatuses.end(), this->expectedStatuses.begin());
+    }
+
+    /// Any other status means that the request has failed in an unexpected way.
+    constexpr bool isExpectedStatus(boost::beast::http::status status) const {
+        auto end = expectedStatuses.begin() + expectedStatusCount;
+        return std::find(expectedStatuses.begin(), end, status) != end;
+    }
+
+    std::string_view host;
+    /// The path without the query, which is added from the parameters of each request.
+    std::string_view path;
+    boost::beast::http::verb method;
+    std::array<boost::beast::http::status, MAX_EXPECTED_STATUSES> expectedStatuses;
+    std::size_t expectedStatusCount;
+};
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HttpHeaderBuilder.h"
+
+#include <algorithm>
+
+namespace http = boost::beast::http;
+
+HttpHeaderBuilder::HttpHeaderBuilder() : fieldCount(0), bufferSize(0) {}
+
+void HttpHeaderBuilder::add(std::string_view name, std::string_view value) {
+    if (fieldCount == MAX_FIELDS) {
+        throw CapacityExceededException();
+    }
+    fields[fieldCount++] = {name, value};
+}
+
+void HttpHeaderBuilder::add(std::string_view name, std::string_view valuePrefix, std::string_view value) {
+    std::size_t valueSize = valuePrefix.size() + value.size();
+    if (bufferSize + valueSize > BUFFER_SIZE) {
+        throw CapacityExceededException();
+    }
+    char* valueStart = buffer.data() + bufferSize;
+    std::copy(value.begin(), value.end(), std::copy(valuePrefix.begin(), valuePrefix.end(), valueStart));
+    bufferSize += valueSize;
+    add(name, std::string_view(valueStart, valueSize));
+}
+
+void HttpHeaderBuilder::applyTo(http::request<http::string_body>& request) const {
+    for (std::size_t i = 0; i < fieldCount; i++) {
+        request.set(fields[i].first, fields[i].second);
+    }
+}
+
+const char* HttpHeaderBuilder::CapacityExceededException::what() const noexcept {
+    return "CapacityExceededException";
+}
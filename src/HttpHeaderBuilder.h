@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <string_view>
+#include <utility>
+
+#include "BoostAsio.h"
+
+/// Collects the header fields of a request in fixed-capacity storage instead of the heap.
+/// A value is either a view of a string that outlives the builder, or is composed in the inline buffer.
+class HttpHeaderBuilder {
+public:
+    static constexpr std::size_t MAX_FIELDS = 8;
+    static constexpr std::size_t BUFFER_SIZE = 512;
+
+    using Field = std::pair<std::string_view, std::string_view>;
+
+    HttpHeaderBuilder();
+    // The fields may point into the buffer, so the builder can't be copied.
+    HttpHeaderBuilder(const HttpHeaderBuilder&) = delete;
+    HttpHeaderBuilder& operator=(const HttpHeaderBuilder&) = delete;
+
+    /// The name and the value have to outlive the builder.
+    void add(std::string_view name, std::string_view value);
+    /// Composes the value from the prefix and the rest in the inline buffer, e.g. "Bearer " and an access token.
+    void add(std::string_view name, std::string_view valuePrefix, std::string_view value);
+
+    void applyTo(boost::beast::http::request<boost::beast::http::string_body>& request) const;
+
+    class CapacityExceededException : public std::exception {
+    public:
+        const char* what() const noexcept override;
+    };
+
+private:
+    std::array<Field, MAX_FIELDS> fields;
+    std::size_t fieldCount;
+    std::array<char, BUFFER_SIZE> buffer;
+    std::size_t bufferSize;
+};
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HttpLatencyMetrics.h"
+
+#include "Log.h"
+
+const char* HttpLatencyMetrics::getStageName(Stage stage) {
+    switch (stage) {
+    case Stage::DNS: return "DNS";
+    case Stage::CONNECT: return "connect";
+    case Stage::TLS_HANDSHAKE: return "TLS handshake";
+    case Stage::TIME_TO_FIRST_BYTE: return "time to first byte";
+    case Stage::BODY_READ: return "body read";
+    case Stage::TOTAL: return "total";
+    }
+    return "unknown";
+}
+
+HttpLatencyMetrics::HttpLatencyMetrics() = default;
+
+HttpLatencyMetrics::~HttpLatencyMetrics() = default;
+
+void HttpLatencyMetrics::Endpoint::record(Stage stage, std::chrono::steady_clock::duration duration) {
+    histograms[static_cast<std::size_t>(stage)].record(duration);
+}
+
+LatencyHistogram::Summary HttpLatencyMetrics::Endpoint::getSummary(Stage stage) const {
+    return histograms[static_cast<std::size_t>(stage)].getSummary();
+}
+
+HttpLatencyMetrics::Endpoint& HttpLatencyMetrics::getEndpoint(const std::string& endpoint) {
+    std::lock_guard guard(endpointsMutex);
+    return endpoints.try_emplace(endpoint).first->second;
+}
+
+std::map<std::string, HttpLatencyMetrics::Summaries> HttpLatencyMetrics::getSummaries() const {
+    std::lock_guard guard(endpointsMutex);
+    std::map<std::string, Summaries> summaries;
+    for (const auto& [name, endpoint] : endpoints) {
+        Summaries& endpointSummaries = summaries[name];
+        for (std::size_t i = 0; i < STAGE_COUNT; i++) {
+            endpointSummaries[i] = endpoint.getSummary(static_cast<Stage>(i));
+        }
+    }
+    return summaries;
+}
+
+void HttpLatencyMetrics::logSummaries() const {
+    for (const auto& [name, summaries] : getSummaries()) {
+        for (std::size_t i = 0; i < STAGE_COUNT; i++) {
+            if (summaries[i].count == 0) {
+                continue;
+            }
+            log(
+                LOG_INFO,
+                "HTTP latency of {}, {}: {}",
+                name,
+                getStageName(static_cast<Stage>(i)),
+                LatencyHistogram::format(summaries[i])
+            );
+        }
+    }
+}
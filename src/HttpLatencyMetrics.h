@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "LatencyHistogram.h"
+
+/// Latency histograms of the stages of HTTP requests, per endpoint, i.e. per host and path without the query.
+class HttpLatencyMetrics {
+public:
+    enum class Stage {
+        DNS,
+        CONNECT,
+        TLS_HANDSHAKE,
+        /// From the start of writing the request to the end of reading the response header.
+        TIME_TO_FIRST_BYTE,
+        BODY_READ,
+        /// The whole request, including the retries.
+        TOTAL,
+    };
+    static constexpr std::size_t STAGE_COUNT = 6;
+    static const char* getStageName(Stage stage);
+
+    HttpLatencyMetrics();
+    ~HttpLatencyMetrics();
+
+    class Endpoint {
+    public:
+        void record(Stage stage, std::chrono::steady_clock::duration duration);
+        LatencyHistogram::Summary getSummary(Stage stage) const;
+
+    private:
+        std::array<LatencyHistogram, STAGE_COUNT> histograms;
+    };
+
+    /// Finds or creates the histograms of the endpoint. Only the lookup takes a lock, recording into the returned
+    /// histograms is lock-free. The reference stays valid for the lifetime of HttpLatencyMetrics.
+    Endpoint& getEndpoint(const std::string& endpoint);
+
+    using Summaries = std::array<LatencyHistogram::Summary, STAGE_COUNT>;
+    std::map<std::string, Summaries> getSummaries() const;
+
+    /// Dumps the summaries of all the endpoints to the OBS log.
+    void logSummaries() const;
+
+private:
+    // std::map never moves its elements, so the references to them stay valid.
+    std::map<std::string, Endpoint> endpoints;
+    mutable std::mutex endpointsMutex;
+};
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "HttpRetryPolicy.h"
+
+#include <algorithm>
+
+namespace http = boost::beast::http;
+using namespace std::chrono_literals;
+
+const HttpRetryPolicy::Config HttpRetryPolicy::DEFAULT_CONFIG{
+    .maxAttempts = 4,
+    .initialBackoff = 250ms,
+    .maxBackoff = 8s,
+    .budgetRatio = 0.2,
+    .maxBudget = 10,
+};
+
+HttpRetryPolicy::HttpRetryPolicy(const Config& config)
+    : config(config), budget(config.maxBudget), randomEngine(std::random_device()()) {}
+
+bool HttpRetryPolicy::isIdempotent(http::verb method) {
+    switch (method) {
+    case http::verb::get:
+    case http::verb::head:
+    case http::verb::put:
+    case http::verb::delete_:
+    // PATCH isn't idempotent in general, but the Helix PATCH requests set fields to absolute values.
+    case http::verb::patch: return true;
+    default: return false;
+    }
+}
+
+bool HttpRetryPolicy::isRetryableStatus(http::status status) {
+    switch (status) {
+    case http::status::internal_server_error:
+    case http::status::bad_gateway:
+    case http::status::service_unavailable:
+    case http::status::gateway_timeout: return true;
+    default: return false;
+    }
+}
+
+void HttpRetryPolicy::onRequestStarted() {
+    std::lock_guard guard(mutex);
+    budget = std::min(config.maxBudget, budget + config.budgetRatio);
+}
+
+bool HttpRetryPolicy::tryStartRetry(http::verb method, unsigned failedAttempt) {
+    if (!isIdempotent(method) || failedAttempt >= config.maxAttempts) {
+        return false;
+    }
+    std::lock_guard guard(mutex);
+    if (budget < 1) {
+        return false;
+    }
+    budget -= 1;
+    return true;
+}
+
+std::chrono::milliseconds HttpRetryPolicy::getBackoff(unsigned failedAttempt) {
+    std::chrono::milliseconds exponentialBackoff = config.initialBackoff * (1LL << std::min(failedAttempt - 1, 16u));
+    std::chrono::milliseconds maxBackoff = std::min(config.maxBackoff, exponentialBackoff);
+    std::lock_guard guard(mutex);
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(0, maxBackoff.count());
+    return std::chrono::milliseconds(distribution(randomEngine));
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <random>
+
+#include "BoostAsio.h"
+
+/// Decides whether a failed request should be retried, and how long to wait before that.
+/// Only idempotent requests are retried. To keep retries from turning an outage into a request storm,
+/// they're limited by a budget: every request adds budgetRatio tokens, every retry takes one token.
+class HttpRetryPolicy {
+public:
+    struct Config {
+        unsigned maxAttempts;
+        std::chrono::milliseconds initialBackoff;
+        std::chrono::milliseconds maxBackoff;
+        double budgetRatio;
+        double maxBudget;
+    };
+    static const Config DEFAULT_CONFIG;
+
+    HttpRetryPolicy(const Config& config = DEFAULT_CONFIG);
+
+    static bool isIdempotent(boost::beast::http::verb method);
+    static bool isRetryableStatus(boost::beast::http::status status);
+
+    /// Call once per request, before the first attempt.
+    void onRequestStarted();
+    /// Returns true and takes a token from the budget if the attempt that has just failed may be retried.
+    bool tryStartRetry(boost::beast::http::verb method, unsigned failedAttempt);
+    /// Exponential backoff with full jitter.
+    std::chrono::milliseconds getBackoff(unsigned failedAttempt);
+
+private:
+    const Config config;
+    double budget;
+    std::default_random_engine randomEngine;
+    std::mutex mutex;
+};
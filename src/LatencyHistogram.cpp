@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "LatencyHistogram.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+
+LatencyHistogram::LatencyHistogram() : buckets{}, count(0), sumMicroseconds(0), maxMicroseconds(0) {}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration duration) {
+    std::int64_t signedMicroseconds = std::chrono::ceil<std::chrono::microseconds>(duration).count();
+    auto microseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(0, signedMicroseconds));
+    buckets[getBucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+
+    std::uint64_t max = maxMicroseconds.load(std::memory_order_relaxed);
+    while (microseconds > max && !maxMicroseconds.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::getSummary() const {
+    std::array<std::uint64_t, BUCKET_COUNT> counts;
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    std::uint64_t sum = sumMicroseconds.load(std::memory_order_relaxed);
+    std::chrono::microseconds max(maxMicroseconds.load(std::memory_order_relaxed));
+    return Summary{
+        total,
+        std::chrono::microseconds(total == 0 ? 0 : sum / total),
+        getPercentile(counts, total, max, 0.5),
+        getPercentile(counts, total, max, 0.9),
+        getPercentile(counts, total, max, 0.99),
+        getPercentile(counts, total, max, 0.999),
+        max,
+    };
+}
+
+std::string LatencyHistogram::format(const Summary& summary) {
+    auto toMilliseconds = [](std::chrono::microseconds duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+    return fmt::format(
+        "count={} mean={:.1f}ms p50={:.1f}ms p90={:.1f}ms p99={:.1f}ms p999={:.1f}ms max={:.1f}ms",
+        summary.count,
+        toMilliseconds(summary.mean),
+        toMilliseconds(summary.p50),
+        toMilliseconds(summary.p90),
+        toMilliseconds(summary.p99),
+        toMilliseconds(summary.p999),
+        toMilliseconds(summary.max)
+    );
+}
+
+std::chrono::microseconds LatencyHistogram::getPercentile(
+    const std::array<std::uint64_t, BUCKET_COUNT>& counts,
+    std::uint64_t total,
+    std::chrono::microseconds max,
+    double percentile
+) {
+    if (total == 0) {
+        return std::chrono::microseconds(0);
+    }
+    auto rank = static_cast<std::uint64_t>(percentile * static_cast<double>(total - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // The max is a tighter bound than the bucket boundary for the slowest durations.
+            return std::min(std::chrono::microseconds(getBucketEnd(i)), max);
+        }
+    }
+    return max;
+}
+
+std::size_t LatencyHistogram::getBucket(std::uint64_t microseconds) {
+    // The first SUB_BUCKET_COUNT buckets hold a single value each. After them, every power-of-two range
+    // [2^e, 2^(e+1)) is split into SUB_BUCKET_COUNT buckets of 2^(e-SUB_BUCKET_BITS) microseconds.
+    if (microseconds < SUB_BUCKET_COUNT) {
+        return static_cast<std::size_t>(microseconds);
+    }
+    auto exponent = static_cast<std::size_t>(std::bit_width(microseconds)) - 1;
+    if (exponent >= MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    std::size_t shift = exponent - SUB_BUCKET_BITS;
+    auto subBucket = static_cast<std::size_t>(microseconds >> shift) - SUB_BUCKET_COUNT;
+    return SUB_BUCKET_COUNT * (shift + 1) + subBucket;
+}
+
+std::uint64_t LatencyHistogram::getBucketEnd(std::size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return bucket + 1;
+    }
+    std::size_t shift = bucket / SUB_BUCKET_COUNT - 1;
+    std::size_t subBucket = bucket % SUB_BUCKET_COUNT;
+    return static_cast<std::uint64_t>(SUB_BUCKET_COUNT + subBucket + 1) << shift;
+}
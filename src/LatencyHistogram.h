@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// A histogram of durations in the style of HdrHistogram, from 1 microsecond to about 35 minutes. Every power-of-two
+/// range of microseconds is split into SUB_BUCKET_COUNT linear sub-buckets, so the percentiles are within 12.5% of
+/// the exact values regardless of the magnitude, while the histogram stays a few kilobytes.
+/// Recording is lock-free and wait-free, so it can be done from any thread on the hot path.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(std::chrono::steady_clock::duration duration);
+
+    struct Summary {
+        std::uint64_t count;
+        std::chrono::microseconds mean;
+        // The percentiles are rounded up to the upper bound of their bucket.
+        std::chrono::microseconds p50;
+        std::chrono::microseconds p90;
+        std::chrono::microseconds p99;
+        std::chrono::microseconds p999;
+        std::chrono::microseconds max;
+    };
+    /// The buckets are read one by one, so the summary may miss the durations recorded concurrently.
+    Summary getSummary() const;
+
+    /// Formats the summary for the log.
+    static std::string format(const Summary& summary);
+
+private:
+    static constexpr std::size_t SUB_BUCKET_BITS = 3;
+    static constexpr std::size_t SUB_BUCKET_COUNT = std::size_t(1) << SUB_BUCKET_BITS;
+    /// The durations from 2^MAX_EXPONENT microseconds, about 35 minutes, go to the last bucket.
+    static constexpr std::size_t MAX_EXPONENT = 31;
+    static constexpr std::size_t BUCKET_COUNT = SUB_BUCKET_COUNT * (MAX_EXPONENT - SUB_BUCKET_BITS + 1);
+
+    static std::size_t getBucket(std::uint64_t microseconds);
+    /// The exclusive upper bound of the bucket.
+    static std::uint64_t getBucketEnd(std::size_t bucket);
+
+    static std::chrono::microseconds getPercentile(
+        const std::array<std::uint64_t, BUCKET_COUNT>& counts,
+        std::uint64_t total,
+        std::chrono::microseconds max,
+        double percentile
+    );
+
+    std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> buckets;
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> sumMicroseconds;
+    std::atomic<std::uint64_t> maxMicroseconds;
+};
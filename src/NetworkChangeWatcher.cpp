@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "NetworkChangeWatcher.h"
+
+#include <chrono>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Log.h"
+
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#endif
+
+namespace asio = boost::asio;
+
+#ifdef __linux__
+
+using namespace std::chrono_literals;
+
+using NetlinkSocket = asio::generic::raw_protocol::socket;
+/// The local addresses and the default routes, serialized. It's needed to tell the actual changes from the lifetime
+/// refreshes of IPv6 addresses, which are notified on every router advertisement.
+using NetworkState = std::set<std::string>;
+
+// The network changes in bursts, e.g. the old address and route go away and then the new ones come up, so the callback
+// is called once the burst is over.
+static const auto SETTLE_DELAY = 500ms;
+static const std::size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+static void openSocket(NetlinkSocket& socket);
+static asio::awaitable<void> asyncLoadState(NetlinkSocket& socket, std::vector<char>& buffer, NetworkState& state);
+static bool applyMessages(const std::vector<char>& buffer, std::size_t size, NetworkState& state, bool& dumpDone);
+static std::optional<std::string> getAddressKey(nlmsghdr* header);
+static std::optional<std::string> getDefaultRouteKey(nlmsghdr* header);
+
+#endif
+
+NetworkChangeWatcher::NetworkChangeWatcher(
+    [[maybe_unused]] asio::io_context& ioContext,
+    [[maybe_unused]] std::function<void()> onNetworkChanged
+) {
+#ifdef __linux__
+    asio::co_spawn(ioContext, asyncWatch(std::move(onNetworkChanged)), asio::detached);
+#endif
+}
+
+NetworkChangeWatcher::~NetworkChangeWatcher() = default;
+
+#ifdef __linux__
+
+asio::awaitable<void> NetworkChangeWatcher::asyncWatch(std::function<void()> onNetworkChanged) {
+    auto executor = co_await asio::this_coro::executor;
+    NetlinkSocket socket(executor);
+    std::vector<char> buffer(RECEIVE_BUFFER_SIZE);
+    NetworkState state;
+    try {
+        openSocket(socket);
+        co_await asyncLoadState(socket, buffer, state);
+    } catch (const std::exception& exception) {
+        log(LOG_WARNING, "Network changes won't be detected: {}", exception.what());
+        co_return;
+    }
+
+    asio::steady_timer settleTimer(executor, asio::steady_timer::time_point::max());
+    while (true) {
+        bool changed = false;
+        bool notificationsLost = false;
+        try {
+            // wait_for_one() ends the race on a receive error too, unlike the || operator, which would wait for the
+            // timer. The timer is at max while idle.
+            auto race = asio::experimental::make_parallel_group(
+                socket.async_receive(asio::buffer(buffer), asio::deferred), settleTimer.async_wait(asio::deferred)
+            );
+            auto [order, receiveEc, bytesReceived, timerEc] =
+                co_await race.async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
+            if (order[0] == 1) {
+                settleTimer.expires_at(asio::steady_timer::time_point::max());
+                log(LOG_INFO, "The network has changed, replacing the connections");
+                onNetworkChanged();
+                continue;
+            }
+            if (receiveEc) {
+                throw boost::system::system_error(receiveEc);
+            }
+            bool dumpDone = false;
+            changed = applyMessages(buffer, bytesReceived, state, dumpDone);
+        } catch (const boost::system::system_error& error) {
+            if (error.code() != asio::error::no_buffer_space) {
+                log(LOG_ERROR, "Exception in NetworkChangeWatcher::asyncWatch: {}", error.what());
+                co_return;
+            }
+            notificationsLost = true;
+        }
+
+        if (notificationsLost) {
+            // The socket buffer has overflown, so whatever has been dropped may have been a change.
+            try {
+                co_await asyncLoadState(socket, buffer, state);
+            } catch (const std::exception& exception) {
+                log(LOG_ERROR, "Exception in NetworkChangeWatcher::asyncWatch: {}", exception.what());
+                co_return;
+            }
+            changed = true;
+        }
+        if (changed && settleTimer.expiry() == asio::steady_timer::time_point::max()) {
+            settleTimer.expires_after(SETTLE_DELAY);
+        }
+    }
+}
+
+static void openSocket(NetlinkSocket& socket) {
+    socket.open(asio::generic::raw_protocol(AF_NETLINK, NETLINK_ROUTE));
+    sockaddr_nl address{};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+    socket.bind(asio::generic::raw_protocol::endpoint(&address, sizeof(address)));
+}
+
+static asio::awaitable<void> asyncLoadState(NetlinkSocket& socket, std::vector<char>& buffer, NetworkState& state) {
+    state.clear();
+    for (std::uint16_t type : {RTM_GETADDR, RTM_GETROUTE}) {
+        struct {
+            nlmsghdr header;
+            rtgenmsg message;
+        } request{};
+        request.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtgenmsg));
+        request.header.nlmsg_type = type;
+        request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.message.rtgen_family = AF_UNSPEC;
+        co_await socket.async_send(asio::buffer(&request, request.header.nlmsg_len), asio::use_awaitable);
+
+        // The notifications that arrive in the meantime are applied as well.
+        bool dumpDone = false;
+        while (!dumpDone) {
+            std::size_t size = co_await socket.async_receive(asio::buffer(buffer), asio::use_awaitable);
+            applyMessages(buffer, size, state, dumpDone);
+        }
+    }
+}
+
+static bool applyMessages(const std::vector<char>& buffer, std::size_t size, NetworkState& state, bool& dumpDone) {
+    bool changed = false;
+    auto length = static_cast<int>(size);
+    auto header = reinterpret_cast<nlmsghdr*>(const_cast<char*>(buffer.data()));
+    for (; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+        std::optional<std::string> key;
+        bool added = false;
+        switch (header->nlmsg_type) {
+        case NLMSG_DONE:
+        case NLMSG_ERROR: dumpDone = true; break;
+        case RTM_NEWADDR: added = true; [[fallthrough]];
+        case RTM_DELADDR: key = getAddressKey(header); break;
+        case RTM_NEWROUTE: added = true; [[fallthrough]];
+        case RTM_DELROUTE: key = getDefaultRouteKey(header); break;
+        }
+        if (!key.has_value()) {
+            continue;
+        }
+        if (added) {
+            changed |= state.insert(key.value()).second;
+        } else {
+            changed |= state.erase(key.value()) > 0;
+        }
+    }
+    return changed;
+}
+
+static std::optional<std::string> getAddressKey(nlmsghdr* header) {
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(ifaddrmsg))) {
+        return {};
+    }
+    auto message = static_cast<ifaddrmsg*>(NLMSG_DATA(header));
+    // Link-local addresses don't lead to the internet, and the temporary IPv6 addresses are rotated while the network
+    // stays the same.
+    if (message->ifa_scope != RT_SCOPE_UNIVERSE || (message->ifa_flags & IFA_F_TEMPORARY)) {
+        return {};
+    }
+    auto length = static_cast<int>(IFA_PAYLOAD(header));
+    for (rtattr* attribute = IFA_RTA(message); RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+        if (attribute->rta_type == IFA_ADDRESS) {
+            std::string key = "address " + std::to_string(message->ifa_index) + " ";
+            key.append(static_cast<const char*>(RTA_DATA(attribute)), RTA_PAYLOAD(attribute));
+            return key;
+        }
+    }
+    return {};
+}
+
+static std::optional<std::string> getDefaultRouteKey(nlmsghdr* header) {
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(rtmsg))) {
+        return {};
+    }
+    auto message = static_cast<rtmsg*>(NLMSG_DATA(header));
+    if (message->rtm_dst_len != 0 || message->rtm_type != RTN_UNICAST) {
+        return {};
+    }
+    // A default route is identified by its table, interface and gateway.
+    std::string key = "route " + std::to_string(message->rtm_family) + " " + std::to_string(message->rtm_table);
+    auto length = static_cast<int>(RTM_PAYLOAD(header));
+    for (rtattr* attribute = RTM_RTA(message); RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+        if (attribute->rta_type == RTA_TABLE || attribute->rta_type == RTA_OIF || attribute->rta_type == RTA_GATEWAY) {
+            key += " " + std::to_string(attribute->rta_type) + " ";
+            key.append(static_cast<const char*>(RTA_DATA(attribute)), RTA_PAYLOAD(attribute));
+        }
+    }
+    return key;
+}
+
+#endif
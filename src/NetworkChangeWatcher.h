@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <functional>
+
+#include "BoostAsio.h"
+
+/// Watches the default routes and the local addresses, and calls the callback once they change, e.g. when the PC
+/// fails over to another uplink or a VPN goes up or down. The connections made over the old network are usually dead
+/// by then, but look alive until their keepalives time out, so they're better replaced right away.
+///
+/// Only Linux is supported, where the changes are read from an rtnetlink socket. On the other platforms the callback
+/// is never called, and the dead connections are still detected by the keepalives.
+class NetworkChangeWatcher {
+public:
+    /// The callback is called on the io_context, once per burst of changes.
+    NetworkChangeWatcher(boost::asio::io_context& ioContext, std::function<void()> onNetworkChanged);
+    ~NetworkChangeWatcher();
+
+private:
+#ifdef __linux__
+    static boost::asio::awaitable<void> asyncWatch(std::function<void()> onNetworkChanged);
+#endif
+};
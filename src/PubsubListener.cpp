@@ -6,7 +6,7 @@
 #include <fmt/core.h>
 
 #include "Log.h"
-#include "TwitchRewardsApi.h"
+#include "PubsubMessageDecoder.h"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -18,25 +18,78 @@ using tcp = asio::ip::tcp;
 using namespace boost::asio::experimental::awaitable_operators;
 using namespace std::chrono_literals;
 
-static const auto RECONNECT_DELAY = 10s;
+// Twitch requires PING messages to keep the connection, dead connections are detected sooner by WebsocketKeepalive.
 static const auto PING_PERIOD = 15s;
 static const char* const CHANNEL_POINTS_TOPIC = "channel-points-channel-v1";
+// The hot standby connection is started a bit later, so that the two connections don't reconnect in lockstep.
+static const auto HOT_STANDBY_STAGGER = 3s;
+// Both connections deliver a redemption within seconds, so the ids don't need to be remembered for long.
+static const auto HOT_STANDBY_DEDUPLICATION_WINDOW = 1min;
+static const std::size_t HOT_STANDBY_DEDUPLICATION_MAX_SIZE = 1024;
 
-PubsubListener::PubsubListener(TwitchAuth& twitchAuth, RewardRedemptionQueue& rewardRedemptionQueue)
-    : twitchAuth(twitchAuth), rewardRedemptionQueue(rewardRedemptionQueue), pubsubThread(1),
-      usernameCondVar(pubsubThread.ioContext, boost::posix_time::pos_infin),
-      lastPongReceivedAt(std::chrono::steady_clock::now()) {
+PubsubListener::PubsubListener(
+    TwitchAuth& twitchAuth,
+    RewardRedemptionQueue& rewardRedemptionQueue,
+    RedemptionReconciler& redemptionReconciler,
+    TlsContext& tlsContext,
+    DnsCache& dnsCache,
+    HappyEyeballsConnector& happyEyeballsConnector,
+    WebsocketCompression& websocketCompression,
+    bool enabled,
+    bool hotStandbyEnabled
+)
+    : twitchAuth(twitchAuth), rewardRedemptionQueue(rewardRedemptionQueue), redemptionReconciler(redemptionReconciler),
+      tlsContext(tlsContext), dnsCache(dnsCache), happyEyeballsConnector(happyEyeballsConnector),
+      websocketCompression(websocketCompression), enabled(enabled), pubsubThread(1),
+      reconnectCondVar(pubsubThread.ioContext, boost::posix_time::pos_infin),
+      connectionCount(hotStandbyEnabled ? MAX_CONNECTION_COUNT : 1), reconnectGeneration(0),
+      redemptionDeduplicator(HOT_STANDBY_DEDUPLICATION_WINDOW, HOT_STANDBY_DEDUPLICATION_MAX_SIZE),
+      firstDeliveryCounts{} {
     connect(&twitchAuth, &TwitchAuth::onUsernameChanged, this, &PubsubListener::reconnectAfterUsernameChange);
-    asio::co_spawn(pubsubThread.ioContext, asyncReconnectToPubsubForever(), asio::detached);
+    for (std::size_t i = 0; i < connectionCount; i++) {
+        asio::co_spawn(pubsubThread.ioContext, asyncReconnectToPubsubForever(i), asio::detached);
+    }
 }
 
 PubsubListener::~PubsubListener() {
     pubsubThread.stop();
 }
 
+void PubsubListener::setEnabled(bool enabled) {
+    this->enabled = enabled;
+    notifyReconnectCondVar();
+}
+
+void PubsubListener::reconnect() {
+    asio::post(pubsubThread.ioContext, [this] {
+        reconnectGeneration++;
+        reconnectCondVar.cancel();
+    });
+}
+
 void PubsubListener::reconnectAfterUsernameChange() {
+    notifyReconnectCondVar();
+}
+
+void PubsubListener::logHotStandbyMetrics() const {
+    if (connectionCount == 1) {
+        return;
+    }
+    log(
+        LOG_INFO,
+        "PubSub hot standby: connection 0 was first {} times, connection 1 was first {} times",
+        firstDeliveryCounts[0].load(),
+        firstDeliveryCounts[1].load()
+    );
+    LatencyHistogram::Summary summary = hotStandbyLagHistogram.getSummary();
+    if (summary.count > 0) {
+        log(LOG_INFO, "PubSub hot standby lag: {}", LatencyHistogram::format(summary));
+    }
+}
+
+void PubsubListener::notifyReconnectCondVar() {
     asio::post(pubsubThread.ioContext, [this] {
-        usernameCondVar.cancel();  // Equivalent to notify_all() for a condition variable.
+        reconnectCondVar.cancel();  // Equivalent to notify_all() for a condition variable.
     });
 }
 
@@ -44,55 +97,76 @@ const char* PubsubListener::NoPingAnswerException::what() const noexcept {
     return "NoPingAnswerException";
 }
 
-asio::awaitable<void> PubsubListener::asyncReconnectToPubsubForever() {
+asio::awaitable<void> PubsubListener::asyncReconnectToPubsubForever(std::size_t connectionIndex) {
+    ReconnectBackoff reconnectBackoff;
+    if (connectionIndex > 0) {
+        co_await asio::steady_timer(pubsubThread.ioContext, HOT_STANDBY_STAGGER).async_wait(asio::use_awaitable);
+    }
     while (true) {
         std::optional<std::string> usernameOptional = twitchAuth.getUsername();
-        if (!usernameOptional.has_value()) {
+        if (!enabled || !usernameOptional.has_value()) {
             try {
-                co_await usernameCondVar.async_wait(asio::use_awaitable);
+                co_await reconnectCondVar.async_wait(asio::use_awaitable);
             } catch (const boost::system::system_error&) {
-                // Username updated.
+                // Username updated or PubSub enabled.
             }
             continue;
         }
         std::string username = usernameOptional.value();
 
+        std::uint64_t generation = reconnectGeneration;
         try {
-            co_await (asyncConnectToPubsub(username) && usernameCondVar.async_wait(asio::use_awaitable));
+            co_await (
+                asyncConnectToPubsub(username, connectionIndex, reconnectBackoff) &&
+                reconnectCondVar.async_wait(asio::use_awaitable)
+            );
         } catch (const std::exception& e) {
             log(LOG_ERROR, "Exception in asyncReconnectToPubsubForever: {}", e.what());
         }
 
-        if (twitchAuth.getUsername() != username) {
-            // Disconnected because of a username change - reconnect immediately.
+        if (!enabled || twitchAuth.getUsername() != username || reconnectGeneration != generation) {
+            // Disconnected on purpose: because of a username change, because PubSub has been disabled or by
+            // reconnect(). Don't wait.
+            reconnectBackoff.reset();
             continue;
         }
-        co_await asio::steady_timer(pubsubThread.ioContext, RECONNECT_DELAY).async_wait(asio::use_awaitable);
+        std::chrono::milliseconds reconnectDelay = reconnectBackoff.onDisconnected();
+        // The wait is cut short by the same events as the connection, e.g. by reconnect() once the network is back.
+        // Unlike the || operator, wait_for_one() also ends the race when the condition variable is cancelled.
+        asio::steady_timer backoffTimer(pubsubThread.ioContext, reconnectDelay);
+        auto race = asio::experimental::make_parallel_group(
+            backoffTimer.async_wait(asio::deferred), reconnectCondVar.async_wait(asio::deferred)
+        );
+        co_await race.async_wait(asio::experimental::wait_for_one(), asio::use_awaitable);
     }
 }
 
-asio::awaitable<void> PubsubListener::asyncConnectToPubsub(const std::string& username) {
-    log(LOG_INFO, "Connecting to PubSub for user {}", username);
+asio::awaitable<void> PubsubListener::asyncConnectToPubsub(
+    const std::string& username,
+    std::size_t connectionIndex,
+    ReconnectBackoff& reconnectBackoff
+) {
+    log(LOG_INFO, "Connecting to PubSub for user {} (connection {})", username, connectionIndex);
     WebsocketStream ws = co_await asyncConnect("pubsub-edge.twitch.tv");
     co_await asyncSubscribeToChannelPoints(ws);
-    co_await (asyncSendPingMessages(ws) && asyncReadMessages(ws));
+    reconnectBackoff.onConnected();
+    RedemptionReconciler::Connection reconcilerConnection(redemptionReconciler);
+    auto lastPongReceivedAt = std::chrono::steady_clock::now();
+    co_await (
+        asyncSendPingMessages(ws, lastPongReceivedAt) && asyncReadMessages(ws, connectionIndex, lastPongReceivedAt)
+    );
 }
 
 asio::awaitable<PubsubListener::WebsocketStream> PubsubListener::asyncConnect(const std::string& host) {
-    ssl::context sslContext{ssl::context::tlsv12};
-    sslContext.set_default_verify_paths();
-    tcp::resolver resolver{pubsubThread.ioContext};
-    WebsocketStream ws{pubsubThread.ioContext, sslContext};
-    const auto resolveResults = co_await resolver.async_resolve(host, "https", asio::use_awaitable);
-
-    co_await asio::async_connect(get_lowest_layer(ws), resolveResults, asio::use_awaitable);
-    if (!SSL_set_tlsext_host_name(ws.next_layer().native_handle(), host.c_str())) {
-        throw boost::system::system_error(
-            boost::system::error_code(static_cast<int>(::ERR_get_error()), asio::error::get_ssl_category()),
-            "Failed to set SNI Hostname"
-        );
-    }
+    WebsocketStream ws{pubsubThread.ioContext, *tlsContext.get()};
+    const auto resolveResults = co_await dnsCache.resolve(host, "https");
+
+    co_await happyEyeballsConnector.connect(get_lowest_layer(ws), host, resolveResults);
+    WebsocketKeepalive::enable(ws);
+    tlsContext.prepareHandshake(ws.next_layer().native_handle(), host);
     co_await ws.next_layer().async_handshake(ssl::stream_base::client, asio::use_awaitable);
+    tlsContext.onHandshakeCompleted(ws.next_layer().native_handle());
+    websocketCompression.enable(ws);
     co_await ws.async_handshake(host, "/", asio::use_awaitable);
     co_return ws;
 }
@@ -115,7 +189,10 @@ asio::awaitable<void> PubsubListener::asyncSubscribeToChannelPoints(WebsocketStr
     co_await asyncSendMessage(ws, message);
 }
 
-asio::awaitable<void> PubsubListener::asyncSendPingMessages(WebsocketStream& ws) {
+asio::awaitable<void> PubsubListener::asyncSendPingMessages(
+    WebsocketStream& ws,
+    const std::chrono::steady_clock::time_point& lastPongReceivedAt
+) {
     json::value message{{"type", "PING"}};
     while (true) {
         auto sentPingAt = std::chrono::steady_clock::now();
@@ -127,40 +204,51 @@ asio::awaitable<void> PubsubListener::asyncSendPingMessages(WebsocketStream& ws)
     }
 }
 
-asio::awaitable<void> PubsubListener::asyncReadMessages(WebsocketStream& ws) {
+asio::awaitable<void> PubsubListener::asyncReadMessages(
+    WebsocketStream& ws,
+    std::size_t connectionIndex,
+    std::chrono::steady_clock::time_point& lastPongReceivedAt
+) {
+    // The buffer and the decoder are reused for all the messages of the connection.
+    beast::flat_buffer buffer;
+    PubsubMessageDecoder decoder;
+    WebsocketCompression::Counter trafficCounter(websocketCompression, ws.next_layer().native_handle());
     while (true) {
-        json::value message = co_await asyncReadMessage(ws);
-        std::string type = value_to<std::string>(message.at("type"));
-        if (type == "PONG") {
+        buffer.clear();
+        co_await ws.async_read(buffer, asio::use_awaitable);
+        auto receivedAt = std::chrono::steady_clock::now();
+        trafficCounter.recordMessage(buffer.size());
+        PubsubMessageDecoder::Message message = decoder.decodeMessage(
+            std::string_view(static_cast<const char*>(buffer.cdata().data()), buffer.size())
+        );
+        if (message.type == "PONG") {
             lastPongReceivedAt = std::chrono::steady_clock::now();
-        } else if (type == "MESSAGE") {
-            std::string topic = value_to<std::string>(message.at("data").at("topic"));
-            if (!topic.starts_with(CHANNEL_POINTS_TOPIC)) {
+        } else if (message.type == "MESSAGE") {
+            if (!message.topic.starts_with(CHANNEL_POINTS_TOPIC)) {
                 continue;
             }
-
-            json::value rewardMessage = json::parse(value_to<std::string>(message.at("data").at("message")));
-            std::string rewardMessageType = value_to<std::string>(rewardMessage.at("type"));
-            if (rewardMessageType != "reward-redeemed") {
-                continue;
+            if (std::optional<RewardRedemption> redemption = decoder.decodeRedemption(message.data)) {
+                redemption->timestamps.receivedAt = receivedAt;
+                onRewardRedemption(redemption.value(), connectionIndex);
             }
-
-            json::value redemption = rewardMessage.at("data").at("redemption");
-            Reward reward = TwitchRewardsApi::parsePubsubReward(redemption.at("reward"));
-            std::string redemptionId = value_to<std::string>(redemption.at("id"));
-            rewardRedemptionQueue.queueRewardRedemption(RewardRedemption{reward, redemptionId});
         }
     }
 }
 
-asio::awaitable<json::value> PubsubListener::asyncReadMessage(WebsocketStream& ws) {
-    std::string message;
-    auto buffer = asio::dynamic_buffer(message);
-    co_await ws.async_read(buffer, asio::use_awaitable);
-    if (message.empty()) {
-        co_return json::value{};
+void PubsubListener::onRewardRedemption(const RewardRedemption& rewardRedemption, std::size_t connectionIndex) {
+    if (connectionCount == 1) {
+        rewardRedemptionQueue.queueRewardRedemption(rewardRedemption);
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::optional<RedemptionDeduplicator::Delivery> firstDelivery =
+        redemptionDeduplicator.checkAndInsert(rewardRedemption.redemptionId, connectionIndex, now);
+    if (firstDelivery.has_value()) {
+        hotStandbyLagHistogram.record(now - firstDelivery->receivedAt);
+        return;
     }
-    co_return json::parse(message);
+    firstDeliveryCounts[connectionIndex]++;
+    rewardRedemptionQueue.queueRewardRedemption(rewardRedemption);
 }
 
 asio::awaitable<void> PubsubListener::asyncSendMessage(WebsocketStream& ws, const json::value& message) {
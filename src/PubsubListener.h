@@ -3,23 +3,60 @@
 
 #pragma once
 #include <QObject>
+#include <array>
+#include <atomic>
 #include <boost/json.hpp>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 
 #include "BoostAsio.h"
+#include "DnsCache.h"
+#include "HappyEyeballsConnector.h"
 #include "IoThreadPool.h"
+#include "LatencyHistogram.h"
+#include "ReconnectBackoff.h"
+#include "RedemptionDeduplicator.h"
+#include "RedemptionReconciler.h"
 #include "RewardRedemptionQueue.h"
+#include "TlsContext.h"
 #include "TwitchAuth.h"
+#include "WebsocketCompression.h"
+#include "WebsocketKeepalive.h"
 
 /// Listens to channel points redemptions. Read https://dev.twitch.tv/docs/pubsub/ for API documentation.
+///
+/// In the hot standby mode, two independent connections are subscribed to the same topic, so that while one of them
+/// reconnects, the other one still delivers the redemptions. The redemptions from both are deduplicated by id.
 class PubsubListener : public QObject {
     Q_OBJECT
 
 public:
-    PubsubListener(TwitchAuth& twitchAuth, RewardRedemptionQueue& rewardRedemptionQueue);
+    PubsubListener(
+        TwitchAuth& twitchAuth,
+        RewardRedemptionQueue& rewardRedemptionQueue,
+        RedemptionReconciler& redemptionReconciler,
+        TlsContext& tlsContext,
+        DnsCache& dnsCache,
+        HappyEyeballsConnector& happyEyeballsConnector,
+        WebsocketCompression& websocketCompression,
+        bool enabled,
+        bool hotStandbyEnabled
+    );
     ~PubsubListener();
 
+    /// Connects or disconnects. Thread-safe.
+    void setEnabled(bool enabled);
+
+    /// Drops the connection and connects again right away, without the backoff, e.g. when the network has changed.
+    /// Thread-safe.
+    void reconnect();
+
+    /// Dumps which of the hot standby connections delivered the redemptions first, and how much later the other one
+    /// delivered them, to the OBS log.
+    void logHotStandbyMetrics() const;
+
 private slots:
     void reconnectAfterUsernameChange();
 
@@ -30,18 +67,46 @@ private:
         const char* what() const noexcept override;
     };
 
-    boost::asio::awaitable<void> asyncReconnectToPubsubForever();
-    boost::asio::awaitable<void> asyncConnectToPubsub(const std::string& username);
+    static constexpr std::size_t MAX_CONNECTION_COUNT = 2;
+
+    void notifyReconnectCondVar();
+    boost::asio::awaitable<void> asyncReconnectToPubsubForever(std::size_t connectionIndex);
+    boost::asio::awaitable<void> asyncConnectToPubsub(
+        const std::string& username,
+        std::size_t connectionIndex,
+        ReconnectBackoff& reconnectBackoff
+    );
     boost::asio::awaitable<WebsocketStream> asyncConnect(const std::string& host);
     boost::asio::awaitable<void> asyncSubscribeToChannelPoints(WebsocketStream& ws);
-    boost::asio::awaitable<void> asyncSendPingMessages(WebsocketStream& ws);
-    boost::asio::awaitable<void> asyncReadMessages(WebsocketStream& ws);
-    static boost::asio::awaitable<boost::json::value> asyncReadMessage(WebsocketStream& ws);
+    boost::asio::awaitable<void> asyncSendPingMessages(
+        WebsocketStream& ws,
+        const std::chrono::steady_clock::time_point& lastPongReceivedAt
+    );
+    boost::asio::awaitable<void> asyncReadMessages(
+        WebsocketStream& ws,
+        std::size_t connectionIndex,
+        std::chrono::steady_clock::time_point& lastPongReceivedAt
+    );
+    void onRewardRedemption(const RewardRedemption& rewardRedemption, std::size_t connectionIndex);
     static boost::asio::awaitable<void> asyncSendMessage(WebsocketStream& ws, const boost::json::value& message);
 
     TwitchAuth& twitchAuth;
     RewardRedemptionQueue& rewardRedemptionQueue;
+    RedemptionReconciler& redemptionReconciler;
+    TlsContext& tlsContext;
+    DnsCache& dnsCache;
+    HappyEyeballsConnector& happyEyeballsConnector;
+    WebsocketCompression& websocketCompression;
+    std::atomic<bool> enabled;
     IoThreadPool pubsubThread;
-    boost::asio::deadline_timer usernameCondVar;
-    std::chrono::steady_clock::time_point lastPongReceivedAt;
+    boost::asio::deadline_timer reconnectCondVar;
+    const std::size_t connectionCount;
+    /// Incremented by reconnect(). Only used on pubsubThread.
+    std::uint64_t reconnectGeneration;
+
+    // Only used on pubsubThread.
+    RedemptionDeduplicator redemptionDeduplicator;
+    std::array<std::atomic<std::uint64_t>, MAX_CONNECTION_COUNT> firstDeliveryCounts;
+    /// How much later the other connection has delivered a redemption.
+    LatencyHistogram hotStandbyLagHistogram;
 };
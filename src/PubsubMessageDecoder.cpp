@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "PubsubMessageDecoder.h"
+
+#include <fmt/core.h>
+
+#include <boost/json/basic_parser_impl.hpp>
+#include <boost/url.hpp>
+
+#include "TwitchRewardsApi.h"
+
+namespace json = boost::json;
+
+static const char* const REWARD_REDEEMED_TYPE = "reward-redeemed";
+
+PubsubMessageDecoder::DecodingException::DecodingException(const std::string& message)
+    : message(fmt::format("PubsubMessageDecoder::DecodingException: {}", message)) {}
+
+const char* PubsubMessageDecoder::DecodingException::what() const noexcept {
+    return message.c_str();
+}
+
+PubsubMessageDecoder::PubsubMessageDecoder() : parser(json::parse_options()) {}
+
+PubsubMessageDecoder::~PubsubMessageDecoder() = default;
+
+PubsubMessageDecoder::Message PubsubMessageDecoder::decodeMessage(std::string_view message) {
+    Handler& handler = parser.handler();
+    handler.decodingData = false;
+    parse(message);
+    return Message{handler.type, handler.topic, handler.data};
+}
+
+std::optional<RewardRedemption> PubsubMessageDecoder::decodeRedemption(std::string_view data) {
+    Handler& handler = parser.handler();
+    handler.decodingData = true;
+    parse(data);
+    if (handler.dataType != REWARD_REDEEMED_TYPE) {
+        return {};
+    }
+    // An empty id would be deduplicated against every other redemption without one, so such events are rejected.
+    if (handler.redemptionId.empty()) {
+        throw DecodingException("the redemption id is missing");
+    }
+    if (handler.rewardId.empty()) {
+        throw DecodingException("the reward id is missing");
+    }
+    if (handler.title.empty()) {
+        throw DecodingException("the reward title is missing");
+    }
+
+    const std::string& imageUrl = handler.imageUrl.empty() ? handler.defaultImageUrl : handler.imageUrl;
+    auto parsedImageUrl = boost::urls::parse_uri(imageUrl);
+    if (!parsedImageUrl) {
+        throw DecodingException(fmt::format("invalid image URL {}", imageUrl));
+    }
+    auto getOptionalSetting = [](const OptionalSetting& setting) -> std::optional<std::int64_t> {
+        if (!setting.isEnabled) {
+            return {};
+        }
+        return setting.value;
+    };
+    RedemptionTimestamps timestamps;
+    timestamps.source = RedemptionSource::PUBSUB;
+    try {
+        timestamps.redeemedAt = TwitchRewardsApi::parseTimestamp(handler.redeemedAt);
+    } catch (const TwitchRewardsApi::InvalidTimestampException&) {
+        // It's only needed for the latency metrics, so the redemption is still played.
+    }
+    // The format of the reward for PubSub events differs slightly from the Helix one.
+    return RewardRedemption{
+        Reward{
+            handler.rewardId,
+            handler.title,
+            handler.prompt,
+            static_cast<std::int32_t>(handler.cost),
+            parsedImageUrl.value(),
+            handler.isEnabled,
+            handler.backgroundColor,
+            getOptionalSetting(handler.maxPerStream),
+            getOptionalSetting(handler.maxPerUserPerStream),
+            getOptionalSetting(handler.globalCooldown),
+            false,
+        },
+        handler.redemptionId,
+        timestamps,
+    };
+}
+
+void PubsubMessageDecoder::parse(std::string_view json) {
+    parser.reset();
+    json::error_code ec;
+    parser.write_some(false, json.data(), json.size(), ec);
+    if (ec) {
+        throw DecodingException(ec.message());
+    }
+}
+
+bool PubsubMessageDecoder::Handler::on_document_begin(json::error_code&) {
+    depth = 0;
+    field = Field::ROOT;
+    partialKey.clear();
+    partialString.clear();
+    if (decodingData) {
+        clearData();
+    } else {
+        type.clear();
+        topic.clear();
+        data.clear();
+    }
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_document_end(json::error_code&) {
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_array_begin(json::error_code&) {
+    // Nothing is picked out of arrays.
+    if (depth < MAX_DEPTH) {
+        parents[depth] = Field::OTHER;
+    }
+    depth++;
+    field = Field::OTHER;
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_array_end(std::size_t, json::error_code&) {
+    depth--;
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_object_begin(json::error_code&) {
+    if (depth < MAX_DEPTH) {
+        parents[depth] = field;
+    }
+    depth++;
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_object_end(std::size_t, json::error_code&) {
+    depth--;
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_string_part(json::string_view s, std::size_t, json::error_code&) {
+    if (getStringField(field)) {
+        partialString.append(s.data(), s.size());
+    }
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_string(json::string_view s, std::size_t, json::error_code&) {
+    if (std::string* stringField = getStringField(field)) {
+        if (partialString.empty()) {
+            stringField->assign(s.data(), s.size());
+        } else {
+            partialString.append(s.data(), s.size());
+            stringField->swap(partialString);
+            partialString.clear();
+        }
+    }
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_key_part(json::string_view s, std::size_t, json::error_code&) {
+    partialKey.append(s.data(), s.size());
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_key(json::string_view s, std::size_t, json::error_code&) {
+    std::string_view key(s.data(), s.size());
+    if (!partialKey.empty()) {
+        partialKey.append(key);
+        key = partialKey;
+    }
+    field = getChildField(getParentField(), key);
+    partialKey.clear();
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_number_part(json::string_view, json::error_code&) {
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_int64(std::int64_t i, json::string_view, json::error_code&) {
+    switch (field) {
+    case Field::COST:
+        cost = i;
+        break;
+    case Field::MAX_PER_STREAM_VALUE:
+        maxPerStream.value = i;
+        break;
+    case Field::MAX_PER_USER_PER_STREAM_VALUE:
+        maxPerUserPerStream.value = i;
+        break;
+    case Field::GLOBAL_COOLDOWN_VALUE:
+        globalCooldown.value = i;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_uint64(std::uint64_t u, json::string_view s, json::error_code& ec) {
+    return on_int64(static_cast<std::int64_t>(u), s, ec);
+}
+
+bool PubsubMessageDecoder::Handler::on_double(double, json::string_view, json::error_code&) {
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_bool(bool b, json::error_code&) {
+    switch (field) {
+    case Field::IS_ENABLED:
+        isEnabled = b;
+        break;
+    case Field::MAX_PER_STREAM_ENABLED:
+        maxPerStream.isEnabled = b;
+        break;
+    case Field::MAX_PER_USER_PER_STREAM_ENABLED:
+        maxPerUserPerStream.isEnabled = b;
+        break;
+    case Field::GLOBAL_COOLDOWN_ENABLED:
+        globalCooldown.isEnabled = b;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_null(json::error_code&) {
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_comment_part(json::string_view, json::error_code&) {
+    return true;
+}
+
+bool PubsubMessageDecoder::Handler::on_comment(json::string_view, json::error_code&) {
+    return true;
+}
+
+PubsubMessageDecoder::Field PubsubMessageDecoder::Handler::getChildField(Field parent, std::string_view key) {
+    switch (parent) {
+    case Field::ROOT:
+        if (key == "type") {
+            return Field::TYPE;
+        } else if (key == "data") {
+            return Field::DATA;
+        }
+        break;
+    case Field::DATA:
+        if (key == "topic") {
+            return Field::TOPIC;
+        } else if (key == "message") {
+            return Field::MESSAGE;
+        } else if (key == "redemption") {
+            return Field::REDEMPTION;
+        }
+        break;
+    case Field::REDEMPTION:
+        if (key == "id") {
+            return Field::REDEMPTION_ID;
+        } else if (key == "redeemed_at") {
+            return Field::REDEEMED_AT;
+        } else if (key == "reward") {
+            return Field::REWARD;
+        }
+        break;
+    case Field::REWARD:
+        if (key == "id") {
+            return Field::REWARD_ID;
+        } else if (key == "title") {
+            return Field::TITLE;
+        } else if (key == "prompt") {
+            return Field::PROMPT;
+        } else if (key == "cost") {
+            return Field::COST;
+        } else if (key == "is_enabled") {
+            return Field::IS_ENABLED;
+        } else if (key == "background_color") {
+            return Field::BACKGROUND_COLOR;
+        } else if (key == "image") {
+            return Field::IMAGE;
+        } else if (key == "default_image") {
+            return Field::DEFAULT_IMAGE;
+        } else if (key == "max_per_stream") {
+            return Field::MAX_PER_STREAM;
+        } else if (key == "max_per_user_per_stream") {
+            return Field::MAX_PER_USER_PER_STREAM;
+        } else if (key == "global_cooldown") {
+            return Field::GLOBAL_COOLDOWN;
+        }
+        break;
+    case Field::IMAGE:
+        if (key == "url_4x") {
+            return Field::IMAGE_URL;
+        }
+        break;
+    case Field::DEFAULT_IMAGE:
+        if (key == "url_4x") {
+            return Field::DEFAULT_IMAGE_URL;
+        }
+        break;
+    case Field::MAX_PER_STREAM:
+        if (key == "is_enabled") {
+            return Field::MAX_PER_STREAM_ENABLED;
+        } else if (key == "max_per_stream") {
+            return Field::MAX_PER_STREAM_VALUE;
+        }
+        break;
+    case Field::MAX_PER_USER_PER_STREAM:
+        if (key == "is_enabled") {
+            return Field::MAX_PER_USER_PER_STREAM_ENABLED;
+        } else if (key == "max_per_user_per_stream") {
+            return Field::MAX_PER_USER_PER_STREAM_VALUE;
+        }
+        break;
+    case Field::GLOBAL_COOLDOWN:
+        if (key == "is_enabled") {
+            return Field::GLOBAL_COOLDOWN_ENABLED;
+        } else if (key == "global_cooldown_seconds") {
+            return Field::GLOBAL_COOLDOWN_VALUE;
+        }
+        break;
+    default:
+        break;
+    }
+    return Field::OTHER;
+}
+
+PubsubMessageDecoder::Field PubsubMessageDecoder::Handler::getParentField() const {
+    if (depth == 0 || depth > MAX_DEPTH) {
+        return Field::OTHER;
+    }
+    return parents[depth - 1];
+}
+
+std::string* PubsubMessageDecoder::Handler::getStringField(Field field) {
+    switch (field) {
+    case Field::TYPE:
+        return decodingData ? &dataType : &type;
+    case Field::TOPIC:
+        return decodingData ? nullptr : &topic;
+    case Field::MESSAGE:
+        // The data is being decoded from this very string.
+        return decodingData ? nullptr : &data;
+    case Field::REDEMPTION_ID:
+        return &redemptionId;
+    case Field::REDEEMED_AT:
+        return &redeemedAt;
+    case Field::REWARD_ID:
+        return &rewardId;
+    case Field::TITLE:
+        return &title;
+    case Field::PROMPT:
+        return &prompt;
+    case Field::BACKGROUND_COLOR:
+        return &backgroundColor;
+    case Field::IMAGE_URL:
+        return &imageUrl;
+    case Field::DEFAULT_IMAGE_URL:
+        return &defaultImageUrl;
+    default:
+        return nullptr;
+    }
+}
+
+void PubsubMessageDecoder::Handler::clearData() {
+    dataType.clear();
+    redemptionId.clear();
+    redeemedAt.clear();
+    rewardId.clear();
+    title.clear();
+    prompt.clear();
+    cost = 0;
+    isEnabled = false;
+    backgroundColor.clear();
+    imageUrl.clear();
+    defaultImageUrl.clear();
+    maxPerStream = OptionalSetting();
+    maxPerUserPerStream = OptionalSetting();
+    globalCooldown = OptionalSetting();
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <array>
+#include <boost/json/basic_parser.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "Reward.h"
+
+/// Decodes PubSub messages without building JSON trees. A SAX parser picks out the few fields that are needed
+/// and copies them into strings. The parser and the strings are reused, so once they have grown to the size
+/// of the messages, only building the RewardRedemption itself allocates.
+class PubsubMessageDecoder {
+public:
+    /// The views point into the decoder and stay valid until the next decodeMessage() call.
+    struct Message {
+        std::string_view type;
+        std::string_view topic;
+        /// The JSON of the topic-specific message, sent as a string inside the outer message.
+        std::string_view data;
+    };
+
+    class DecodingException : public std::exception {
+    public:
+        DecodingException(const std::string& message);
+        const char* what() const noexcept override;
+
+    private:
+        std::string message;
+    };
+
+    PubsubMessageDecoder();
+    PubsubMessageDecoder(const PubsubMessageDecoder&) = delete;
+    PubsubMessageDecoder& operator=(const PubsubMessageDecoder&) = delete;
+    ~PubsubMessageDecoder();
+
+    Message decodeMessage(std::string_view message);
+
+    /// Decodes the data of a channel points message. Returns an empty optional for the events other than
+    /// reward-redeemed. Only timestamps.redeemedAt is set, and only if it's valid. Throws DecodingException if
+    /// the redemption id, the reward id or the title is missing.
+    std::optional<RewardRedemption> decodeRedemption(std::string_view data);
+
+private:
+    /// The fields that are picked out of the messages, the rest is skipped.
+    enum class Field : std::uint8_t {
+        OTHER,
+        ROOT,
+        TYPE,
+        DATA,
+        TOPIC,
+        MESSAGE,
+        REDEMPTION,
+        REDEMPTION_ID,
+        REDEEMED_AT,
+        REWARD,
+        REWARD_ID,
+        TITLE,
+        PROMPT,
+        COST,
+        IS_ENABLED,
+        BACKGROUND_COLOR,
+        IMAGE,
+        IMAGE_URL,
+        DEFAULT_IMAGE,
+        DEFAULT_IMAGE_URL,
+        MAX_PER_STREAM,
+        MAX_PER_STREAM_ENABLED,
+        MAX_PER_STREAM_VALUE,
+        MAX_PER_USER_PER_STREAM,
+        MAX_PER_USER_PER_STREAM_ENABLED,
+        MAX_PER_USER_PER_STREAM_VALUE,
+        GLOBAL_COOLDOWN,
+        GLOBAL_COOLDOWN_ENABLED,
+        GLOBAL_COOLDOWN_VALUE,
+    };
+
+    struct OptionalSetting {
+        bool isEnabled = false;
+        std::int64_t value = 0;
+    };
+
+    /// The callbacks of boost::json::basic_parser.
+    class Handler {
+    public:
+        static constexpr std::size_t max_object_size = std::size_t(-1);
+        static constexpr std::size_t max_array_size = std::size_t(-1);
+        static constexpr std::size_t max_key_size = std::size_t(-1);
+        static constexpr std::size_t max_string_size = std::size_t(-1);
+
+        bool on_document_begin(boost::json::error_code& ec);
+        bool on_document_end(boost::json::error_code& ec);
+        bool on_array_begin(boost::json::error_code& ec);
+        bool on_array_end(std::size_t n, boost::json::error_code& ec);
+        bool on_object_begin(boost::json::error_code& ec);
+        bool on_object_end(std::size_t n, boost::json::error_code& ec);
+        bool on_string_part(boost::json::string_view s, std::size_t n, boost::json::error_code& ec);
+        bool on_string(boost::json::string_view s, std::size_t n, boost::json::error_code& ec);
+        bool on_key_part(boost::json::string_view s, std::size_t n, boost::json::error_code& ec);
+        bool on_key(boost::json::string_view s, std::size_t n, boost::json::error_code& ec);
+        bool on_number_part(boost::json::string_view s, boost::json::error_code& ec);
+        bool on_int64(std::int64_t i, boost::json::string_view s, boost::json::error_code& ec);
+        bool on_uint64(std::uint64_t u, boost::json::string_view s, boost::json::error_code& ec);
+        bool on_double(double d, boost::json::string_view s, boost::json::error_code& ec);
+        bool on_bool(bool b, boost::json::error_code& ec);
+        bool on_null(boost::json::error_code& ec);
+        bool on_comment_part(boost::json::string_view s, boost::json::error_code& ec);
+        bool on_comment(boost::json::string_view s, boost::json::error_code& ec);
+
+        /// Whether the data of a message is being decoded rather than the outer message.
+        bool decodingData = false;
+
+        std::string type;
+        std::string topic;
+        std::string data;
+
+        std::string dataType;
+        std::string redemptionId;
+        std::string redeemedAt;
+        std::string rewardId;
+        std::string title;
+        std::string prompt;
+        std::int64_t cost = 0;
+        bool isEnabled = false;
+        std::string backgroundColor;
+        std::string imageUrl;
+        std::string defaultImageUrl;
+        OptionalSetting maxPerStream;
+        OptionalSetting maxPerUserPerStream;
+        OptionalSetting globalCooldown;
+
+    private:
+        static constexpr std::size_t MAX_DEPTH = 16;
+
+        static Field getChildField(Field parent, std::string_view key);
+        Field getParentField() const;
+        std::string* getStringField(Field field);
+        void clearData();
+
+        /// The fields of the objects and arrays that are currently open.
+        std::array<Field, MAX_DEPTH> parents;
+        std::size_t depth = 0;
+        /// The field of the value that comes next.
+        Field field = Field::ROOT;
+        /// The parts of a key or a string that's split into several callbacks.
+        std::string partialKey;
+        std::string partialString;
+    };
+
+    void parse(std::string_view json);
+
+    boost::json::basic_parser<Handler> parser;
+};
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "ReconnectBackoff.h"
+
+#include <algorithm>
+
+ReconnectBackoff::ReconnectBackoff() : failedAttempts(0), randomEngine(std::random_device()()) {}
+
+void ReconnectBackoff::onConnected() {
+    connectedAt = std::chrono::steady_clock::now();
+}
+
+std::chrono::milliseconds ReconnectBackoff::onDisconnected() {
+    auto now = std::chrono::steady_clock::now();
+    if (connectedAt.has_value() && now - connectedAt.value() >= STABLE_CONNECTION_DURATION) {
+        failedAttempts = 0;
+    }
+    connectedAt.reset();
+
+    std::chrono::milliseconds exponentialBackoff = INITIAL_BACKOFF * (1LL << std::min(failedAttempts, 16u));
+    std::chrono::milliseconds maxBackoff = std::min(MAX_BACKOFF, exponentialBackoff);
+    failedAttempts++;
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(0, maxBackoff.count());
+    return std::chrono::milliseconds(distribution(randomEngine));
+}
+
+void ReconnectBackoff::reset() {
+    failedAttempts = 0;
+    connectedAt.reset();
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <random>
+
+/// Decides how long a listener waits before reconnecting. The first reconnect happens almost immediately, so that
+/// a dropped connection is replaced before any events are missed, and the delay grows exponentially (with full
+/// jitter) while the reconnects keep failing, so that an outage doesn't turn into a reconnect storm.
+/// Not thread-safe: each listener owns one and uses it on its own thread.
+class ReconnectBackoff {
+public:
+    static constexpr std::chrono::milliseconds INITIAL_BACKOFF{100};
+    static constexpr std::chrono::milliseconds MAX_BACKOFF{30000};
+    /// A connection that has lived this long is considered healthy, and the backoff starts over when it drops.
+    static constexpr std::chrono::seconds STABLE_CONNECTION_DURATION{30};
+
+    ReconnectBackoff();
+
+    /// Call when a connection has been established.
+    void onConnected();
+    /// Call when a connection or a connection attempt has failed. Returns how long to wait before reconnecting.
+    std::chrono::milliseconds onDisconnected();
+    /// Starts over, e.g. when the connection is closed on purpose.
+    void reset();
+
+private:
+    unsigned failedAttempts;
+    std::optional<std::chrono::steady_clock::time_point> connectedAt;
+    std::default_random_engine randomEngine;
+};
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "RedemptionDeduplicator.h"
+
+RedemptionDeduplicator::RedemptionDeduplicator(std::chrono::steady_clock::duration window, std::size_t maxSize)
+    : window(window), maxSize(maxSize), currentGenerationStartedAt(std::chrono::steady_clock::now()) {
+    currentGeneration.reserve(maxSize);
+    previousGeneration.reserve(maxSize);
+}
+
+std::optional<RedemptionDeduplicator::Delivery> RedemptionDeduplicator::checkAndInsert(
+    const std::string& redemptionId,
+    std::size_t source,
+    std::chrono::steady_clock::time_point now
+) {
+    if (auto it = currentGeneration.find(redemptionId); it != currentGeneration.end()) {
+        return it->second;
+    }
+    if (auto it = previousGeneration.find(redemptionId); it != previousGeneration.end()) {
+        return it->second;
+    }
+    rotateIfNeeded(now);
+    currentGeneration.emplace(redemptionId, Delivery{now, source});
+    return {};
+}
+
+void RedemptionDeduplicator::rotateIfNeeded(std::chrono::steady_clock::time_point now) {
+    if (now - currentGenerationStartedAt < window && currentGeneration.size() < maxSize) {
+        return;
+    }
+    // Swapping keeps the buckets of both maps allocated.
+    previousGeneration.swap(currentGeneration);
+    currentGeneration.clear();
+    currentGenerationStartedAt = now;
+}
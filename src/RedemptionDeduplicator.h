@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/// Remembers the ids of the recent redemptions, so that a redemption delivered more than once is only handled once.
+/// The ids are kept in two generations: when the current one is older than the window or full, it replaces the
+/// previous one, and a new one is started. So an id is remembered for at least the window, unless more than maxSize
+/// redemptions arrive within it, and the memory stays bounded by 2 * maxSize ids.
+/// Not thread-safe.
+class RedemptionDeduplicator {
+public:
+    struct Delivery {
+        std::chrono::steady_clock::time_point receivedAt;
+        /// Which of the connections has delivered the redemption.
+        std::size_t source;
+    };
+
+    RedemptionDeduplicator(std::chrono::steady_clock::duration window, std::size_t maxSize);
+
+    /// Returns the first delivery if the redemption has already been seen, otherwise remembers this one.
+    std::optional<Delivery> checkAndInsert(
+        const std::string& redemptionId,
+        std::size_t source,
+        std::chrono::steady_clock::time_point now
+    );
+
+private:
+    void rotateIfNeeded(std::chrono::steady_clock::time_point now);
+
+    const std::chrono::steady_clock::duration window;
+    const std::size_t maxSize;
+    std::unordered_map<std::string, Delivery> currentGeneration;
+    std::unordered_map<std::string, Delivery> previousGeneration;
+    std::chrono::steady_clock::time_point currentGenerationStartedAt;
+};
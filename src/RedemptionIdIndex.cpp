@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "RedemptionIdIndex.h"
+
+#include <functional>
+
+static_assert((RedemptionIdIndex::CAPACITY & (RedemptionIdIndex::CAPACITY - 1)) == 0, "CAPACITY must be a power of 2");
+
+RedemptionIdIndex::RedemptionIdIndex(std::chrono::steady_clock::duration window)
+    : window(window), slots(CAPACITY), duplicateCount(0) {}
+
+RedemptionIdIndex::~RedemptionIdIndex() = default;
+
+bool RedemptionIdIndex::insert(std::string_view redemptionId) {
+    std::uint64_t hash = getHash(redemptionId);
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard guard(slotsMutex);
+    Slot* freeSlot = nullptr;
+    Slot* oldestSlot = nullptr;
+    for (std::size_t i = 0; i < MAX_PROBE_LENGTH; i++) {
+        Slot& slot = slots[(hash + i) & (CAPACITY - 1)];
+        if (slot.hash == 0) {
+            // Insertions take the first free slot, so nothing has been inserted past a slot that's never been used.
+            if (!freeSlot) {
+                freeSlot = &slot;
+            }
+            break;
+        }
+        bool isExpired = now - slot.insertedAt >= window;
+        if (slot.hash == hash && !isExpired) {
+            duplicateCount++;
+            return false;
+        }
+        if (isExpired && !freeSlot) {
+            freeSlot = &slot;
+        }
+        if (!oldestSlot || slot.insertedAt < oldestSlot->insertedAt) {
+            oldestSlot = &slot;
+        }
+    }
+
+    Slot* slot = freeSlot ? freeSlot : oldestSlot;
+    slot->hash = hash;
+    slot->insertedAt = now;
+    return true;
+}
+
+std::uint64_t RedemptionIdIndex::getDuplicateCount() const {
+    return duplicateCount;
+}
+
+std::uint64_t RedemptionIdIndex::getHash(std::string_view redemptionId) {
+    std::uint64_t hash = std::hash<std::string_view>()(redemptionId);
+    // 0 marks the unused slots.
+    return hash == 0 ? 1 : hash;
+}
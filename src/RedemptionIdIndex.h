@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+/// A fixed-size set of the recently seen redemption ids, to drop the redemptions that are delivered more than once,
+/// e.g. by PubSub redelivery, by both a listener and the reconciler, or by several connections.
+///
+/// It's an open-addressing hash table of the 64-bit hashes of the ids, with linear probing limited to
+/// MAX_PROBE_LENGTH slots, so both lookups and insertions are O(1). The entries older than the window are treated
+/// as free. If all the probed slots are taken, the oldest entry among them is evicted, so the memory never grows.
+/// A hash collision could drop a redemption, but with 64-bit hashes that's practically impossible.
+class RedemptionIdIndex {
+public:
+    static constexpr std::size_t CAPACITY = 8192;
+    static constexpr std::size_t MAX_PROBE_LENGTH = 16;
+
+    RedemptionIdIndex(std::chrono::steady_clock::duration window);
+    ~RedemptionIdIndex();
+
+    /// Returns false if the id has been seen within the window, otherwise remembers it and returns true.
+    /// Thread-safe.
+    bool insert(std::string_view redemptionId);
+
+    std::uint64_t getDuplicateCount() const;
+
+private:
+    struct Slot {
+        /// 0 for the slots that have never been used.
+        std::uint64_t hash = 0;
+        std::chrono::steady_clock::time_point insertedAt;
+    };
+
+    static std::uint64_t getHash(std::string_view redemptionId);
+
+    const std::chrono::steady_clock::duration window;
+    std::vector<Slot> slots;
+    std::mutex slotsMutex;
+    std::atomic<std::uint64_t> duplicateCount;
+};
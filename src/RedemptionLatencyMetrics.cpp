@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "RedemptionLatencyMetrics.h"
+
+#include "Log.h"
+
+const char* RedemptionLatencyMetrics::getStageName(Stage stage) {
+    switch (stage) {
+    case Stage::PUBSUB_DELIVERY: return "PubSub delivery";
+    case Stage::EVENTSUB_DELIVERY: return "EventSub delivery";
+    case Stage::ENQUEUE: return "enqueue";
+    case Stage::QUEUE_WAIT: return "queue wait";
+    case Stage::SOURCE_START: return "source start";
+    case Stage::MEDIA_START: return "media start";
+    case Stage::FULFILLMENT: return "fulfillment";
+    case Stage::TOTAL: return "total";
+    }
+    return "unknown";
+}
+
+RedemptionLatencyMetrics::RedemptionLatencyMetrics() = default;
+
+RedemptionLatencyMetrics::~RedemptionLatencyMetrics() = default;
+
+void RedemptionLatencyMetrics::record(Stage stage, std::chrono::steady_clock::duration duration) {
+    histograms[static_cast<std::size_t>(stage)].record(duration);
+}
+
+void RedemptionLatencyMetrics::recordDelivery(const RedemptionTimestamps& timestamps) {
+    if (!timestamps.redeemedAt.has_value() || timestamps.source == RedemptionSource::RECONCILED) {
+        return;
+    }
+    // The steady clock can't be compared to the system one, so the receive time is moved over to the system clock.
+    auto sinceReceived = std::chrono::steady_clock::now() - timestamps.receivedAt;
+    auto receivedAt = std::chrono::system_clock::now() -
+                      std::chrono::duration_cast<std::chrono::system_clock::duration>(sinceReceived);
+    Stage stage = timestamps.source == RedemptionSource::EVENTSUB ? Stage::EVENTSUB_DELIVERY : Stage::PUBSUB_DELIVERY;
+    record(stage, receivedAt - timestamps.redeemedAt.value());
+}
+
+RedemptionLatencyMetrics::Summaries RedemptionLatencyMetrics::getSummaries() const {
+    Summaries summaries;
+    for (std::size_t i = 0; i < STAGE_COUNT; i++) {
+        summaries[i] = histograms[i].getSummary();
+    }
+    return summaries;
+}
+
+void RedemptionLatencyMetrics::logSummaries() const {
+    Summaries summaries = getSummaries();
+    for (std::size_t i = 0; i < STAGE_COUNT; i++) {
+        if (summaries[i].count == 0) {
+            continue;
+        }
+        log(
+            LOG_INFO,
+            "Redemption latency, {}: {}",
+            getStageName(static_cast<Stage>(i)),
+            LatencyHistogram::format(summaries[i])
+        );
+    }
+}
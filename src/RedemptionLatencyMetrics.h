@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+#include "LatencyHistogram.h"
+#include "Reward.h"
+
+/// Latency histograms of the hops a redemption makes from Twitch to the screen, to see where the time goes.
+class RedemptionLatencyMetrics {
+public:
+    enum class Stage {
+        /// From the redemption on Twitch to its message being read from the PubSub socket. The redemption time is set
+        /// by the Twitch clock, so any skew of the local clock is included.
+        PUBSUB_DELIVERY,
+        /// The same for EventSub.
+        EVENTSUB_DELIVERY,
+        /// From the socket to the queue, including the decoding and the deduplication.
+        ENQUEUE,
+        /// Waiting in the queue for the previous redemptions to be played.
+        QUEUE_WAIT,
+        /// From the dequeue to startObsSource.
+        SOURCE_START,
+        /// From startObsSource to the media_started signal of the source.
+        MEDIA_START,
+        /// From sending the FULFILLED status update after the playback to Twitch acknowledging it.
+        FULFILLMENT,
+        /// From the socket to the media_started signal, i.e. everything on this side of Twitch.
+        TOTAL,
+    };
+    static constexpr std::size_t STAGE_COUNT = 8;
+    static const char* getStageName(Stage stage);
+
+    RedemptionLatencyMetrics();
+    ~RedemptionLatencyMetrics();
+
+    void record(Stage stage, std::chrono::steady_clock::duration duration);
+    /// Records the delivery stage of the source if the redemption time is known. The reconciled redemptions are
+    /// skipped, as they are fetched long after being redeemed, by design.
+    void recordDelivery(const RedemptionTimestamps& timestamps);
+
+    using Summaries = std::array<LatencyHistogram::Summary, STAGE_COUNT>;
+    Summaries getSummaries() const;
+
+    /// Dumps the summaries of all the stages to the OBS log.
+    void logSummaries() const;
+
+private:
+    std::array<LatencyHistogram, STAGE_COUNT> histograms;
+};
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "RedemptionReconciler.h"
+
+#include <algorithm>
+
+#include "Log.h"
+
+namespace asio = boost::asio;
+using namespace std::chrono_literals;
+
+// A dropped connection is usually replaced within a second, and then the gap is filled anyway.
+static const auto POLLING_START_DELAY = 5s;
+static const auto MIN_POLLING_INTERVAL = 5s;
+static const auto MAX_POLLING_INTERVAL = 1min;
+// Each poll makes at least one request per reward, so with many rewards it's done less often. That keeps the polling
+// at a small fraction of the Helix rate limit of 800 requests per minute.
+static const auto POLLING_INTERVAL_PER_REWARD = 1s;
+// The redemption times are set by the Twitch clock, which may differ from the local one.
+static const auto CLOCK_SKEW_MARGIN = 30s;
+
+RedemptionReconciler::RedemptionReconciler(
+    TwitchAuth& twitchAuth,
+    TwitchRewardsApi& twitchRewardsApi,
+    RewardRedemptionQueue& rewardRedemptionQueue,
+    Settings& settings
+)
+    : twitchAuth(twitchAuth), twitchRewardsApi(twitchRewardsApi), rewardRedemptionQueue(rewardRedemptionQueue),
+      settings(settings), reconcilerThread(1), stateCondVar(reconcilerThread.ioContext), connectionCount(0),
+      reconcilePending(false), disconnectedAt(std::chrono::system_clock::now()) {
+    connect(&twitchRewardsApi, &TwitchRewardsApi::onRewardsUpdated, this, &RedemptionReconciler::updateRewards);
+    asio::co_spawn(reconcilerThread.ioContext, asyncReconcileForever(), asio::detached);
+}
+
+RedemptionReconciler::~RedemptionReconciler() {
+    reconcilerThread.stop();
+}
+
+RedemptionReconciler::Connection::Connection(RedemptionReconciler& reconciler) : reconciler(reconciler) {
+    reconciler.onConnected();
+}
+
+RedemptionReconciler::Connection::~Connection() {
+    reconciler.onDisconnected();
+}
+
+void RedemptionReconciler::updateRewards(const std::variant<std::exception_ptr, std::vector<Reward>>& newRewards) {
+    if (!std::holds_alternative<std::vector<Reward>>(newRewards)) {
+        return;
+    }
+    std::lock_guard guard(rewardsMutex);
+    rewards = std::get<std::vector<Reward>>(newRewards);
+}
+
+void RedemptionReconciler::onConnected() {
+    asio::post(reconcilerThread.ioContext, [this] {
+        connectionCount++;
+        if (connectionCount == 1) {
+            reconcilePending = true;
+            stateCondVar.cancel();
+        }
+    });
+}
+
+void RedemptionReconciler::onDisconnected() {
+    auto now = std::chrono::system_clock::now();
+    asio::post(reconcilerThread.ioContext, [this, now] {
+        connectionCount--;
+        if (connectionCount == 0) {
+            disconnectedAt = now;
+            reconcilePending = false;
+            stateCondVar.cancel();
+        }
+    });
+}
+
+asio::awaitable<bool> RedemptionReconciler::asyncWaitForStateChange(std::chrono::steady_clock::time_point deadline) {
+    stateCondVar.expires_at(deadline);
+    boost::system::error_code ec;
+    co_await stateCondVar.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    // The timer is cancelled on state changes, which is equivalent to notify_all() for a condition variable.
+    co_return ec == asio::error::operation_aborted;
+}
+
+asio::awaitable<void> RedemptionReconciler::asyncReconcileForever() {
+    std::chrono::steady_clock::duration pollingDelay = POLLING_START_DELAY;
+    while (true) {
+        if (connectionCount > 0) {
+            if (reconcilePending) {
+                // A connection has come up after a gap.
+                reconcilePending = false;
+                co_await asyncReconcile();
+                continue;
+            }
+            pollingDelay = POLLING_START_DELAY;
+            co_await asyncWaitForStateChange(std::chrono::steady_clock::time_point::max());
+            continue;
+        }
+
+        if (co_await asyncWaitForStateChange(std::chrono::steady_clock::now() + pollingDelay)) {
+            continue;
+        }
+        std::size_t queuedCount = co_await asyncReconcile();
+        if (queuedCount > 0) {
+            pollingDelay = MIN_POLLING_INTERVAL;
+        } else {
+            pollingDelay = std::clamp<std::chrono::steady_clock::duration>(
+                pollingDelay * 2, MIN_POLLING_INTERVAL, MAX_POLLING_INTERVAL
+            );
+        }
+        auto rewardCount = static_cast<int>(getReconciledRewards().size());
+        pollingDelay = std::max<std::chrono::steady_clock::duration>(
+            pollingDelay, rewardCount * POLLING_INTERVAL_PER_REWARD
+        );
+    }
+}
+
+asio::awaitable<std::size_t> RedemptionReconciler::asyncReconcile() {
+    if (!twitchAuth.getUsername().has_value()) {
+        co_return 0;
+    }
+    auto startedAt = std::chrono::system_clock::now();
+    std::vector<RewardRedemption> redemptions;
+    try {
+        for (const Reward& reward : getReconciledRewards()) {
+            std::vector<RewardRedemption> rewardRedemptions =
+                co_await twitchRewardsApi.asyncGetUnfulfilledRedemptions(reward, disconnectedAt - CLOCK_SKEW_MARGIN);
+            redemptions.insert(redemptions.end(), rewardRedemptions.begin(), rewardRedemptions.end());
+        }
+    } catch (const std::exception& exception) {
+        log(LOG_ERROR, "Exception in asyncReconcile: {}", exception.what());
+        co_return 0;
+    }
+
+    // Queue them in the order they have been redeemed in.
+    std::sort(redemptions.begin(), redemptions.end(), [](const auto& a, const auto& b) {
+        return a.timestamps.redeemedAt < b.timestamps.redeemedAt;
+    });
+    std::size_t queuedCount = 0;
+    for (const RewardRedemption& redemption : redemptions) {
+        if (rewardRedemptionQueue.queueRewardRedemption(redemption)) {
+            queuedCount++;
+        }
+    }
+    if (queuedCount > 0) {
+        log(LOG_INFO, "Queued {} missed redemptions", queuedCount);
+    }
+
+    if (connectionCount == 0) {
+        // While polling, everything redeemed before this poll has been queued, so the next one can start from here.
+        disconnectedAt = std::max(disconnectedAt, startedAt);
+    }
+    co_return queuedCount;
+}
+
+std::vector<Reward> RedemptionReconciler::getReconciledRewards() {
+    std::lock_guard guard(rewardsMutex);
+    std::vector<Reward> reconciledRewards;
+    for (const Reward& reward : rewards) {
+        if (reward.canManage && settings.getObsSourceName(reward.id).has_value()) {
+            reconciledRewards.push_back(reward);
+        }
+    }
+    return reconciledRewards;
+}
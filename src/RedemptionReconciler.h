@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <QObject>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <variant>
+#include <vector>
+
+#include "BoostAsio.h"
+#include "IoThreadPool.h"
+#include "Reward.h"
+#include "RewardRedemptionQueue.h"
+#include "Settings.h"
+#include "TwitchAuth.h"
+#include "TwitchRewardsApi.h"
+
+/// Recovers the redemptions that have been missed while no PubSub or EventSub connection was up. They stay
+/// UNFULFILLED on Twitch, so once a connection is up again, they're loaded from Helix and queued. If no connection
+/// comes up for a while, Helix is polled instead, less and less often while nothing new turns up.
+///
+/// Only the rewards that are manageable by the plugin and have an OBS source are reconciled, as Helix only returns
+/// the redemptions of the former and the queue ignores the rest. Only the redemptions made since the connection
+/// went down are queued: the older ones have either been delivered or were made before the plugin was started.
+/// The ones that have been delivered since then are dropped by RewardRedemptionQueue as duplicates.
+class RedemptionReconciler : public QObject {
+    Q_OBJECT
+
+public:
+    RedemptionReconciler(
+        TwitchAuth& twitchAuth,
+        TwitchRewardsApi& twitchRewardsApi,
+        RewardRedemptionQueue& rewardRedemptionQueue,
+        Settings& settings
+    );
+    ~RedemptionReconciler();
+
+    /// Keeps the listener counted as connected while it lives. Create it once the listener has subscribed to the
+    /// redemptions.
+    class Connection {
+    public:
+        Connection(RedemptionReconciler& reconciler);
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+        ~Connection();
+
+    private:
+        RedemptionReconciler& reconciler;
+    };
+
+private slots:
+    void updateRewards(const std::variant<std::exception_ptr, std::vector<Reward>>& newRewards);
+
+private:
+    void onConnected();
+    void onDisconnected();
+    /// Returns false if the deadline has passed, true if the state may have changed.
+    boost::asio::awaitable<bool> asyncWaitForStateChange(std::chrono::steady_clock::time_point deadline);
+    boost::asio::awaitable<void> asyncReconcileForever();
+    /// Returns the number of queued redemptions.
+    boost::asio::awaitable<std::size_t> asyncReconcile();
+    std::vector<Reward> getReconciledRewards();
+
+    TwitchAuth& twitchAuth;
+    TwitchRewardsApi& twitchRewardsApi;
+    RewardRedemptionQueue& rewardRedemptionQueue;
+    Settings& settings;
+
+    std::vector<Reward> rewards;
+    std::mutex rewardsMutex;
+
+    IoThreadPool reconcilerThread;
+    boost::asio::steady_timer stateCondVar;
+    // Only used on reconcilerThread.
+    std::size_t connectionCount;
+    bool reconcilePending;
+    std::chrono::system_clock::time_point disconnectedAt;
+};
@@ -54,4 +54,6 @@ Reward::Reward(
 Reward::Reward(const Reward& reward, const RewardData& newRewardData)
     : RewardData(newRewardData), id(reward.id), imageUrl(reward.imageUrl), canManage(reward.canManage) {}
 
-bool RewardRedemption::operator==(const RewardRedemption& other) const = default;
+bool RewardRedemption::operator==(const RewardRedemption& other) const {
+    return reward == other.reward && redemptionId == other.redemptionId;
+}
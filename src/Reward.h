@@ -4,6 +4,7 @@
 #pragma once
 
 #include <boost/url.hpp>
+#include <chrono>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -58,9 +59,30 @@ struct Reward : RewardData {
     Reward(const Reward& reward, const RewardData& newRewardData);
 };
 
+/// Where a redemption has been received from.
+enum class RedemptionSource {
+    PUBSUB,
+    EVENTSUB,
+    /// Fetched from Helix after a disconnection, possibly long after the redemption.
+    RECONCILED,
+};
+
+/// When a redemption has passed the stages of its delivery, for RedemptionLatencyMetrics. The steady clock times are
+/// left empty until the redemption reaches the stage.
+struct RedemptionTimestamps {
+    /// By the Twitch clock. Empty if the source of the redemption doesn't tell.
+    std::optional<std::chrono::system_clock::time_point> redeemedAt;
+    std::chrono::steady_clock::time_point receivedAt;
+    std::chrono::steady_clock::time_point queuedAt;
+    std::chrono::steady_clock::time_point dequeuedAt;
+    RedemptionSource source = RedemptionSource::PUBSUB;
+};
+
 struct RewardRedemption {
     Reward reward;
     std::string redemptionId;
+    RedemptionTimestamps timestamps = {};
 
+    /// The timestamps aren't compared, so the copies of a redemption made at different stages are equal.
     bool operator==(const RewardRedemption& other) const;
 };
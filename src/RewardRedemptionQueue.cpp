@@ -17,8 +17,12 @@
 namespace asio = boost::asio;
 using namespace std::chrono_literals;
 
+// Redeliveries and the redemptions recovered by RedemptionReconciler arrive within minutes of the original ones.
+static const auto REDEMPTION_ID_WINDOW = 30min;
+
 RewardRedemptionQueue::RewardRedemptionQueue(Settings& settings, TwitchRewardsApi& twitchRewardsApi)
-    : settings(settings), twitchRewardsApi(twitchRewardsApi), rewardRedemptionQueueThread(1),
+    : settings(settings), twitchRewardsApi(twitchRewardsApi), redemptionIdIndex(REDEMPTION_ID_WINDOW),
+      rewardRedemptionQueueThread(1),
       ioContext(rewardRedemptionQueueThread.ioContext), rewardPlaybackPaused(false),
       rewardRedemptionQueueCondVar(ioContext, boost::posix_time::pos_infin), playObsSourceState(0),
       libVlc(LibVlc::createSafe()), randomEngine(std::random_device()()) {
@@ -34,30 +38,51 @@ std::vector<RewardRedemption> RewardRedemptionQueue::getRewardRedemptionQueue()
     return rewardRedemptionQueue;
 }
 
-void RewardRedemptionQueue::queueRewardRedemption(const RewardRedemption& rewardRedemption) {
+bool RewardRedemptionQueue::queueRewardRedemption(const RewardRedemption& rewardRedemption) {
+    if (!redemptionIdIndex.insert(rewardRedemption.redemptionId)) {
+        log(LOG_DEBUG, "Dropped duplicate redemption {}", rewardRedemption.redemptionId);
+        return false;
+    }
     std::optional<std::string> obsSourceName = settings.getObsSourceName(rewardRedemption.reward.id);
     if (!obsSourceName.has_value()) {
-        return;
+        return true;
     }
     if (isRewardPlaybackPaused()) {
         twitchRewardsApi.updateRedemptionStatus(rewardRedemption, TwitchRewardsApi::RedemptionStatus::CANCELED);
-        return;
+        return true;
     }
+
+    RewardRedemption queuedRewardRedemption = rewardRedemption;
+    RedemptionTimestamps& timestamps = queuedRewardRedemption.timestamps;
+    timestamps.queuedAt = std::chrono::steady_clock::now();
+    latencyMetrics.recordDelivery(timestamps);
+    latencyMetrics.record(RedemptionLatencyMetrics::Stage::ENQUEUE, timestamps.queuedAt - timestamps.receivedAt);
     if (!settings.isRewardRedemptionQueueEnabled()) {
+        timestamps.dequeuedAt = timestamps.queuedAt;
         playObsSource(
             rewardRedemption.reward.id,
             obsSourceName.value(),
-            settings.getSourcePlaybackSettings(rewardRedemption.reward.id)
+            settings.getSourcePlaybackSettings(rewardRedemption.reward.id),
+            timestamps
         );
-        return;
+        return true;
     }
 
     {
         std::lock_guard<std::mutex> guard(rewardRedemptionQueueMutex);
-        rewardRedemptionQueue.push_back(rewardRedemption);
+        rewardRedemptionQueue.push_back(queuedRewardRedemption);
         emit onRewardRedemptionQueueUpdated(rewardRedemptionQueue);
     }
     notifyRewardRedemptionQueueCondVar();
+    return true;
+}
+
+std::uint64_t RewardRedemptionQueue::getDroppedDuplicateCount() const {
+    return redemptionIdIndex.getDuplicateCount();
+}
+
+const RedemptionLatencyMetrics& RewardRedemptionQueue::getLatencyMetrics() const {
+    return latencyMetrics;
 }
 
 void RewardRedemptionQueue::removeRewardRedemption(const RewardRedemption& rewardRedemption) {
@@ -146,10 +171,13 @@ bool RewardRedemptionQueue::sourceSupportsLoopVideo(const std::string& obsSource
 asio::awaitable<void> RewardRedemptionQueue::asyncPlayRewardRedemptionsFromQueue() {
     while (true) {
         RewardRedemption nextRewardRedemption = co_await asyncGetNextRewardRedemption();
+        RedemptionTimestamps& timestamps = nextRewardRedemption.timestamps;
+        timestamps.dequeuedAt = std::chrono::steady_clock::now();
+        latencyMetrics.record(RedemptionLatencyMetrics::Stage::QUEUE_WAIT, timestamps.dequeuedAt - timestamps.queuedAt);
         try {
             const std::string& rewardId = nextRewardRedemption.reward.id;
             co_await asyncPlayObsSource(
-                rewardId, getObsSource(nextRewardRedemption), settings.getSourcePlaybackSettings(rewardId)
+                rewardId, getObsSource(nextRewardRedemption), settings.getSourcePlaybackSettings(rewardId), timestamps
             );
         } catch (const ObsSourceNoVideoException&) {}
         co_await popPlayedRewardRedemptionFromQueue(nextRewardRedemption);
@@ -195,24 +223,38 @@ asio::awaitable<void> RewardRedemptionQueue::popPlayedRewardRedemptionFromQueue(
         }
         rewardRedemptionQueue.erase(rewardRedemptionQueue.begin());
     }
-    twitchRewardsApi.updateRedemptionStatus(rewardRedemption, TwitchRewardsApi::RedemptionStatus::FULFILLED);
+    asio::co_spawn(ioContext, asyncFulfillRewardRedemption(rewardRedemption), asio::detached);
     emit onRewardRedemptionQueueUpdated(rewardRedemptionQueue);
 }
 
+asio::awaitable<void> RewardRedemptionQueue::asyncFulfillRewardRedemption(RewardRedemption rewardRedemption) {
+    auto sentAt = std::chrono::steady_clock::now();
+    bool acknowledged = co_await twitchRewardsApi.asyncUpdateRedemptionStatus(
+        rewardRedemption, TwitchRewardsApi::RedemptionStatus::FULFILLED
+    );
+    if (acknowledged) {
+        latencyMetrics.record(RedemptionLatencyMetrics::Stage::FULFILLMENT, std::chrono::steady_clock::now() - sentAt);
+    }
+}
+
 void RewardRedemptionQueue::playObsSource(
     const std::string& rewardId,
     const std::string& obsSourceName,
-    const SourcePlaybackSettings& sourcePlaybackSettings
+    const SourcePlaybackSettings& sourcePlaybackSettings,
+    const RedemptionTimestamps& timestamps
 ) {
-    playObsSource(rewardId, getObsSource(obsSourceName), sourcePlaybackSettings);
+    playObsSource(rewardId, getObsSource(obsSourceName), sourcePlaybackSettings, timestamps);
 }
 
 void RewardRedemptionQueue::playObsSource(
     const std::string& rewardId,
     OBSSourceAutoRelease source,
-    const SourcePlaybackSettings& sourcePlaybackSettings
+    const SourcePlaybackSettings& sourcePlaybackSettings,
+    const RedemptionTimestamps& timestamps
 ) {
-    asio::co_spawn(ioContext, asyncPlayObsSource(rewardId, std::move(source), sourcePlaybackSettings), asio::detached);
+    asio::co_spawn(
+        ioContext, asyncPlayObsSource(rewardId, std::move(source), sourcePlaybackSettings, timestamps), asio::detached
+    );
 }
 
 template <class T>
@@ -236,7 +278,8 @@ private:
 asio::awaitable<void> RewardRedemptionQueue::asyncPlayObsSource(
     std::string rewardId,
     OBSSourceAutoRelease source,
-    SourcePlaybackSettings sourcePlaybackSettings
+    SourcePlaybackSettings sourcePlaybackSettings,
+    std::optional<RedemptionTimestamps> timestamps
 ) {
     if (!source) {
         co_return;
@@ -259,6 +302,7 @@ asio::awaitable<void> RewardRedemptionQueue::asyncPlayObsSource(
     };
 
     SourcePlayback sourcePlayback{state, rewardId, source, sourcePlaybackSettings, 0, 1};
+    auto sourceStartedAt = std::chrono::steady_clock::now();
     startObsSource(sourcePlayback);
 
     // Give some time for the source to start, otherwise stop it.
@@ -270,6 +314,12 @@ asio::awaitable<void> RewardRedemptionQueue::asyncPlayObsSource(
         co_return;
     }
     co_await asyncCheckMediaStarted(sourcePlayback, *mediaStartedCallback);
+    if (timestamps.has_value()) {
+        auto mediaStartedAt = mediaStartedCallback->mediaStartedAt;
+        latencyMetrics.record(RedemptionLatencyMetrics::Stage::SOURCE_START, sourceStartedAt - timestamps->dequeuedAt);
+        latencyMetrics.record(RedemptionLatencyMetrics::Stage::MEDIA_START, mediaStartedAt - sourceStartedAt);
+        latencyMetrics.record(RedemptionLatencyMetrics::Stage::TOTAL, mediaStartedAt - timestamps->receivedAt);
+    }
     saveLastVideoSize(sourcePlayback);
 
     deadlineTimer.expires_from_now(getMediaEndDeadline(sourcePlayback));
@@ -283,9 +333,13 @@ RewardRedemptionQueue::MediaStartedCallback::MediaStartedCallback(asio::io_conte
 
 void RewardRedemptionQueue::MediaStartedCallback::setMediaStarted(void* param, [[maybe_unused]] calldata_t* data) {
     std::shared_ptr<MediaStartedCallback> callback = *static_cast<std::shared_ptr<MediaStartedCallback>*>(param);
-    asio::post(callback->ioContext, [callback] {
-        if (callback->enabled) {
+    // The signal is sent on an OBS thread, so the time is taken here rather than once the post is handled.
+    auto now = std::chrono::steady_clock::now();
+    asio::post(callback->ioContext, [callback, now] {
+        // A playlist starts each of its items, only the first one is the start of the playback.
+        if (callback->enabled && !callback->mediaStarted) {
             callback->mediaStarted = true;
+            callback->mediaStartedAt = now;
         }
     });
 }
@@ -387,7 +441,7 @@ asio::awaitable<void> RewardRedemptionQueue::asyncTestObsSource(
     if (!obsSource) {
         throw ObsSourceNotFoundException(obsSourceName);
     }
-    co_await asyncPlayObsSource(rewardId, std::move(obsSource), sourcePlaybackSettings);
+    co_await asyncPlayObsSource(rewardId, std::move(obsSource), sourcePlaybackSettings, {});
 }
 
 bool RewardRedemptionQueue::sourceSupportsLoopVideo(obs_source_t* source) {
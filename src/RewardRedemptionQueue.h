@@ -5,6 +5,7 @@
 
 #include <QObject>
 #include <chrono>
+#include <cstdint>
 #include <exception>
 #include <functional>
 #include <future>
@@ -20,6 +21,8 @@
 
 #include "IoThreadPool.h"
 #include "LibVlc.h"
+#include "RedemptionIdIndex.h"
+#include "RedemptionLatencyMetrics.h"
 #include "Reward.h"
 #include "Settings.h"
 #include "TwitchRewardsApi.h"
@@ -32,7 +35,11 @@ public:
     ~RewardRedemptionQueue() override;
 
     std::vector<RewardRedemption> getRewardRedemptionQueue() const;
-    void queueRewardRedemption(const RewardRedemption& rewardRedemption);
+    /// Returns false if the redemption has already been queued recently, in which case it's dropped. Thread-safe.
+    bool queueRewardRedemption(const RewardRedemption& rewardRedemption);
+    /// The number of the redemptions dropped by queueRewardRedemption as duplicates.
+    std::uint64_t getDroppedDuplicateCount() const;
+    const RedemptionLatencyMetrics& getLatencyMetrics() const;
     void removeRewardRedemption(const RewardRedemption& rewardRedemption);
 
     static std::vector<std::string> enumObsSources();
@@ -74,22 +81,27 @@ private:
     boost::asio::awaitable<RewardRedemption> asyncGetNextRewardRedemption();
     void notifyRewardRedemptionQueueCondVar();
     boost::asio::awaitable<void> popPlayedRewardRedemptionFromQueue(const RewardRedemption& rewardRedemption);
+    boost::asio::awaitable<void> asyncFulfillRewardRedemption(RewardRedemption rewardRedemption);
 
     void playObsSource(
         const std::string& rewardId,
         const std::string& obsSourceName,
-        const SourcePlaybackSettings& sourcePlaybackSettings
+        const SourcePlaybackSettings& sourcePlaybackSettings,
+        const RedemptionTimestamps& timestamps
     );
     void playObsSource(
         const std::string& rewardId,
         OBSSourceAutoRelease source,
-        const SourcePlaybackSettings& sourcePlaybackSettings
+        const SourcePlaybackSettings& sourcePlaybackSettings,
+        const RedemptionTimestamps& timestamps
     );
 
+    /// The timestamps are empty for the test playbacks, which aren't included in the latency metrics.
     boost::asio::awaitable<void> asyncPlayObsSource(
         std::string rewardId,
         OBSSourceAutoRelease source,
-        SourcePlaybackSettings sourcePlaybackSettings
+        SourcePlaybackSettings sourcePlaybackSettings,
+        std::optional<RedemptionTimestamps> timestamps
     );
 
     struct SourcePlayback {
@@ -104,6 +116,7 @@ private:
     struct MediaStartedCallback {
         boost::asio::io_context& ioContext;
         bool mediaStarted = false;
+        std::chrono::steady_clock::time_point mediaStartedAt;
         bool enabled = true;
 
         MediaStartedCallback(boost::asio::io_context& ioContext);
@@ -180,6 +193,8 @@ private:
     Settings& settings;
     TwitchRewardsApi& twitchRewardsApi;
 
+    RedemptionIdIndex redemptionIdIndex;
+    RedemptionLatencyMetrics latencyMetrics;
     IoThreadPool rewardRedemptionQueueThread;
     boost::asio::io_context& ioContext;
     std::vector<RewardRedemption> rewardRedemptionQueue;
@@ -12,6 +12,7 @@
 #include <QMainWindow>
 #include <QMessageBox>
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <memory>
 #include <thread>
@@ -29,18 +30,49 @@ static const int MIN_OBS_VERSION = 503316480;
 static const char* const MIN_OBS_VERSION_STRING = "30.0.0";
 
 RewardsTheaterPlugin::RewardsTheaterPlugin()
-    : settings(obs_frontend_get_global_config()), ioThreadPool(std::max(2u, std::thread::hardware_concurrency())),
-      httpClient(ioThreadPool.ioContext), twitchAuth(
-                                              settings,
-                                              TWITCH_CLIENT_ID,
-                                              {"channel:read:redemptions", "channel:manage:redemptions"},
-                                              AUTH_SERVER_PORTS[std::random_device()() % AUTH_SERVER_PORTS.size()],
-                                              httpClient,
-                                              ioThreadPool.ioContext
-                                          ),
+    : settings(obs_frontend_get_global_config()), tlsContext(settings),
+      ioThreadPool(std::max(2u, std::thread::hardware_concurrency())),
+      dnsCache(ioThreadPool.ioContext, std::chrono::seconds(settings.getDnsCacheTtlSeconds())),
+      websocketCompression(
+          static_cast<int>(settings.getWebsocketDeflateWindowBits()),
+          static_cast<int>(settings.getWebsocketDeflateMemoryLevel())
+      ),
+      httpCache(getHttpCacheDirectory()),
+      httpClient(ioThreadPool.ioContext, tlsContext, dnsCache, happyEyeballsConnector, httpCache),
+      twitchAuth(
+          settings,
+          TWITCH_CLIENT_ID,
+          {"channel:read:redemptions", "channel:manage:redemptions"},
+          AUTH_SERVER_PORTS[std::random_device()() % AUTH_SERVER_PORTS.size()],
+          httpClient,
+          ioThreadPool.ioContext
+      ),
       twitchRewardsApi(twitchAuth, httpClient, settings, ioThreadPool.ioContext),
       githubUpdateApi(httpClient, ioThreadPool.ioContext), rewardRedemptionQueue(settings, twitchRewardsApi),
-      pubsubListener(twitchAuth, rewardRedemptionQueue) {
+      redemptionReconciler(twitchAuth, twitchRewardsApi, rewardRedemptionQueue, settings),
+      pubsubListener(
+          twitchAuth,
+          rewardRedemptionQueue,
+          redemptionReconciler,
+          tlsContext,
+          dnsCache,
+          happyEyeballsConnector,
+          websocketCompression,
+          !settings.isEventsubEnabled(),
+          settings.isPubsubHotStandbyEnabled()
+      ),
+      eventsubListener(
+          twitchAuth,
+          httpClient,
+          rewardRedemptionQueue,
+          redemptionReconciler,
+          tlsContext,
+          dnsCache,
+          happyEyeballsConnector,
+          websocketCompression,
+          settings.isEventsubEnabled()
+      ),
+      networkChangeWatcher(ioThreadPool.ioContext, [this] { onNetworkChanged(); }) {
     log(LOG_INFO, "Loading plugin, version {}", REWARDS_THEATER_VERSION);
     checkMinObsVersion();
     // Удален вызов функции checkRestrictedRegion
@@ -54,7 +86,14 @@ RewardsTheaterPlugin::RewardsTheaterPlugin()
     QAction* action = static_cast<QAction*>(obs_frontend_add_tools_menu_qaction(obs_module_text("RewardsTheater")));
     QObject::connect(action, &QAction::triggered, settingsDialog, &SettingsDialog::toggleVisibility);
 
+    QObject::connect(&twitchAuth, &TwitchAuth::onUserChanged, &twitchAuth, [this] {
+        httpCache.setUser(twitchAuth.getUserId());
+    });
+    httpClient.enableHttp2("api.twitch.tv");
     twitchAuth.startService();
+    httpClient.prewarmConnections({"api.twitch.tv", "id.twitch.tv"}, [this] {
+        return twitchAuth.getUsername().has_value();
+    });
     githubUpdateApi.checkForUpdates();
 }
 
@@ -62,6 +101,27 @@ RewardsTheaterPlugin::~RewardsTheaterPlugin() {
     // Stop the thread pool before destructing the objects that use it,
     // so that no callbacks are called on destructed objects.
     ioThreadPool.stop();
+    httpClient.getLatencyMetrics().logSummaries();
+    TlsSessionCache::Stats sessionCacheStats = tlsContext.getSessionCacheStats();
+    log(
+        LOG_INFO,
+        "TLS handshakes: {} resumed, {} full",
+        sessionCacheStats.resumedHandshakes,
+        sessionCacheStats.fullHandshakes
+    );
+    for (const auto& [endpoint, stats] : httpClient.getCompressionStats()) {
+        log(
+            LOG_INFO,
+            "HTTP traffic for {}: received {} bytes for {} bytes of bodies",
+            endpoint,
+            stats.encodedBytes,
+            stats.decodedBytes
+        );
+    }
+    websocketCompression.logStats();
+    pubsubListener.logHotStandbyMetrics();
+    log(LOG_INFO, "Dropped {} duplicate redemptions", rewardRedemptionQueue.getDroppedDuplicateCount());
+    rewardRedemptionQueue.getLatencyMetrics().logSummaries();
 }
 
 Settings& RewardsTheaterPlugin::getSettings() {
@@ -84,6 +144,20 @@ RewardRedemptionQueue& RewardsTheaterPlugin::getRewardRedemptionQueue() {
     return rewardRedemptionQueue;
 }
 
+void RewardsTheaterPlugin::setEventsubEnabled(bool eventsubEnabled) {
+    settings.setEventsubEnabled(eventsubEnabled);
+    pubsubListener.setEnabled(!eventsubEnabled);
+    eventsubListener.setEnabled(eventsubEnabled);
+}
+
+void RewardsTheaterPlugin::setCaBundlePath(const std::optional<std::string>& caBundlePath) {
+    settings.setCaBundlePath(caBundlePath);
+    tlsContext.reload();
+    httpClient.resetConnections();
+    pubsubListener.reconnect();
+    eventsubListener.reconnect();
+}
+
 const char* RewardsTheaterPlugin::UnsupportedObsVersionException::what() const noexcept {
     return "UnsupportedObsVersionException";
 }
@@ -99,3 +173,22 @@ void RewardsTheaterPlugin::checkMinObsVersion() {
         throw UnsupportedObsVersionException();
     }
 }
+
+std::filesystem::path RewardsTheaterPlugin::getHttpCacheDirectory() {
+    char* path = obs_module_config_path("http-cache");
+    if (!path) {
+        return {};
+    }
+    std::filesystem::path result(reinterpret_cast<const char8_t*>(path));
+    bfree(path);
+    return result;
+}
+
+void RewardsTheaterPlugin::onNetworkChanged() {
+    // The addresses and the preferred families may differ on the new network.
+    dnsCache.clear();
+    happyEyeballsConnector.clear();
+    httpClient.resetConnections();
+    pubsubListener.reconnect();
+    eventsubListener.reconnect();
+}
@@ -4,15 +4,26 @@
 #pragma once
 
 #include <exception>
+#include <filesystem>
+#include <optional>
+#include <string>
 
+#include "DnsCache.h"
+#include "EventsubListener.h"
 #include "GithubUpdateApi.h"
+#include "HappyEyeballsConnector.h"
+#include "HttpCache.h"
 #include "HttpClient.h"
 #include "IoThreadPool.h"
+#include "NetworkChangeWatcher.h"
 #include "PubsubListener.h"
+#include "RedemptionReconciler.h"
 #include "RewardRedemptionQueue.h"
 #include "Settings.h"
+#include "TlsContext.h"
 #include "TwitchAuth.h"
 #include "TwitchRewardsApi.h"
+#include "WebsocketCompression.h"
 
 class RewardsTheaterPlugin {
 public:
@@ -24,6 +35,11 @@ public:
     GithubUpdateApi& getGithubUpdateApi();
     RewardRedemptionQueue& getRewardRedemptionQueue();
 
+    /// Switches between receiving redemptions over EventSub and over PubSub, and saves the choice.
+    void setEventsubEnabled(bool eventsubEnabled);
+    /// Saves the CA bundle path and reconnects everything with the reloaded certificates.
+    void setCaBundlePath(const std::optional<std::string>& caBundlePath);
+
 private:
     class UnsupportedObsVersionException : public std::exception {
         const char* what() const noexcept override;
@@ -35,13 +51,23 @@ private:
 
     void checkMinObsVersion();
     void checkRestrictedRegion();
+    static std::filesystem::path getHttpCacheDirectory();
+    void onNetworkChanged();
 
     Settings settings;
+    TlsContext tlsContext;
     IoThreadPool ioThreadPool;
+    DnsCache dnsCache;
+    HappyEyeballsConnector happyEyeballsConnector;
+    WebsocketCompression websocketCompression;
+    HttpCache httpCache;
     HttpClient httpClient;
     TwitchAuth twitchAuth;
     TwitchRewardsApi twitchRewardsApi;
     GithubUpdateApi githubUpdateApi;
     RewardRedemptionQueue rewardRedemptionQueue;
+    RedemptionReconciler redemptionReconciler;
     PubsubListener pubsubListener;
+    EventsubListener eventsubListener;
+    NetworkChangeWatcher networkChangeWatcher;
 };
@@ -7,6 +7,12 @@ static const char* const PLUGIN_NAME = "RewardsTheater";
 static const char* const REWARD_REDEMPTIONS_QUEUE_ENABLED_KEY = "REWARD_REDEMPTIONS_QUEUE_ENABLED_KEY";
 static const char* const INTERVAL_BETWEEN_REWARDS_SECONDS_KEY = "INTERVAL_BETWEEN_REWARDS_SECONDS_KEY";
 static const char* const TWITCH_ACCESS_TOKEN_KEY = "TWITCH_ACCESS_TOKEN_KEY";
+static const char* const CA_BUNDLE_PATH_KEY = "CA_BUNDLE_PATH_KEY";
+static const char* const DNS_CACHE_TTL_SECONDS_KEY = "DNS_CACHE_TTL_SECONDS_KEY";
+static const char* const EVENTSUB_ENABLED_KEY = "EVENTSUB_ENABLED_KEY";
+static const char* const PUBSUB_HOT_STANDBY_ENABLED_KEY = "PUBSUB_HOT_STANDBY_ENABLED_KEY";
+static const char* const WEBSOCKET_DEFLATE_WINDOW_BITS_KEY = "WEBSOCKET_DEFLATE_WINDOW_BITS_KEY";
+static const char* const WEBSOCKET_DEFLATE_MEMORY_LEVEL_KEY = "WEBSOCKET_DEFLATE_MEMORY_LEVEL_KEY";
 static const char* const RANDOM_POSITION_ENABLED_KEY = "RANDOM_POSITION_ENABLED_KEY";
 static const char* const LOOP_VIDEO_ENABLED_KEY = "LOOP_VIDEO_ENABLED_KEY";
 static const char* const LOOP_VIDEO_DURATION_KEY = "LOOP_VIDEO_DURATION_KEY";
@@ -56,6 +62,59 @@ void Settings::setTwitchAccessToken(const std::optional<std::string>& accessToke
     }
 }
 
+std::optional<std::string> Settings::getCaBundlePath() const {
+    std::lock_guard lock(configMutex);
+    config_set_default_string(config, PLUGIN_NAME, CA_BUNDLE_PATH_KEY, "");
+    std::string result = config_get_string(config, PLUGIN_NAME, CA_BUNDLE_PATH_KEY);
+    if (result.empty()) {
+        return {};
+    } else {
+        return result;
+    }
+}
+
+void Settings::setCaBundlePath(const std::optional<std::string>& caBundlePath) {
+    std::lock_guard lock(configMutex);
+    if (caBundlePath) {
+        config_set_string(config, PLUGIN_NAME, CA_BUNDLE_PATH_KEY, caBundlePath.value().c_str());
+    } else {
+        config_remove_value(config, PLUGIN_NAME, CA_BUNDLE_PATH_KEY);
+    }
+}
+
+std::int64_t Settings::getDnsCacheTtlSeconds() const {
+    config_set_default_int(config, PLUGIN_NAME, DNS_CACHE_TTL_SECONDS_KEY, 300);
+    return config_get_int(config, PLUGIN_NAME, DNS_CACHE_TTL_SECONDS_KEY);
+}
+
+bool Settings::isEventsubEnabled() const {
+    config_set_default_bool(config, PLUGIN_NAME, EVENTSUB_ENABLED_KEY, false);
+    return config_get_bool(config, PLUGIN_NAME, EVENTSUB_ENABLED_KEY);
+}
+
+void Settings::setEventsubEnabled(bool eventsubEnabled) {
+    config_set_bool(config, PLUGIN_NAME, EVENTSUB_ENABLED_KEY, eventsubEnabled);
+}
+
+bool Settings::isPubsubHotStandbyEnabled() const {
+    config_set_default_bool(config, PLUGIN_NAME, PUBSUB_HOT_STANDBY_ENABLED_KEY, false);
+    return config_get_bool(config, PLUGIN_NAME, PUBSUB_HOT_STANDBY_ENABLED_KEY);
+}
+
+void Settings::setPubsubHotStandbyEnabled(bool pubsubHotStandbyEnabled) {
+    config_set_bool(config, PLUGIN_NAME, PUBSUB_HOT_STANDBY_ENABLED_KEY, pubsubHotStandbyEnabled);
+}
+
+std::int64_t Settings::getWebsocketDeflateWindowBits() const {
+    config_set_default_int(config, PLUGIN_NAME, WEBSOCKET_DEFLATE_WINDOW_BITS_KEY, 15);
+    return config_get_int(config, PLUGIN_NAME, WEBSOCKET_DEFLATE_WINDOW_BITS_KEY);
+}
+
+std::int64_t Settings::getWebsocketDeflateMemoryLevel() const {
+    config_set_default_int(config, PLUGIN_NAME, WEBSOCKET_DEFLATE_MEMORY_LEVEL_KEY, 8);
+    return config_get_int(config, PLUGIN_NAME, WEBSOCKET_DEFLATE_MEMORY_LEVEL_KEY);
+}
+
 std::optional<std::string> Settings::getObsSourceName(const std::string& rewardId) const {
     std::lock_guard lock(configMutex);
     config_set_default_string(config, PLUGIN_NAME, rewardId.c_str(), "");
@@ -32,6 +32,28 @@ public:
     std::optional<std::string> getTwitchAccessToken() const;
     void setTwitchAccessToken(const std::optional<std::string>& accessToken);
 
+    /// A PEM file with CA certificates to use instead of the system ones. Applied right away when changed in the
+    /// settings dialog.
+    std::optional<std::string> getCaBundlePath() const;
+    void setCaBundlePath(const std::optional<std::string>& caBundlePath);
+
+    /// For how long resolved host addresses are cached. Only set by editing the config file, applied on restart.
+    std::int64_t getDnsCacheTtlSeconds() const;
+
+    /// Whether redemptions are received over EventSub WebSockets instead of PubSub.
+    bool isEventsubEnabled() const;
+    void setEventsubEnabled(bool eventsubEnabled);
+
+    /// Whether two PubSub connections are kept, so that no redemptions are missed while one of them reconnects.
+    /// Applied on restart.
+    bool isPubsubHotStandbyEnabled() const;
+    void setPubsubHotStandbyEnabled(bool pubsubHotStandbyEnabled);
+
+    /// The permessage-deflate window bits and zlib memory level of the PubSub and EventSub WebSockets.
+    /// Only set by editing the config file, applied on restart.
+    std::int64_t getWebsocketDeflateWindowBits() const;
+    std::int64_t getWebsocketDeflateMemoryLevel() const;
+
     std::optional<std::string> getObsSourceName(const std::string& rewardId) const;
     void setObsSourceName(const std::string& rewardId, const std::optional<std::string>& obsSourceName);
 
@@ -27,6 +27,9 @@ SettingsDialog::SettingsDialog(RewardsTheaterPlugin& plugin, QWidget* parent)
     showGithubLink();
     ui->rewardRedemptionQueueEnabledCheckBox->setChecked(plugin.getSettings().isRewardRedemptionQueueEnabled());
     ui->intervalBetweenRewardsSpinBox->setValue(plugin.getSettings().getIntervalBetweenRewardsSeconds());
+    ui->eventsubEnabledCheckBox->setChecked(plugin.getSettings().isEventsubEnabled());
+    ui->pubsubHotStandbyEnabledCheckBox->setChecked(plugin.getSettings().isPubsubHotStandbyEnabled());
+    ui->caBundlePathEdit->setText(QString::fromStdString(plugin.getSettings().getCaBundlePath().value_or("")));
 
     connect(ui->authButton, &QPushButton::clicked, this, &SettingsDialog::logInOrLogOut);
     connect(
@@ -46,6 +49,14 @@ SettingsDialog::SettingsDialog(RewardsTheaterPlugin& plugin, QWidget* parent)
         this,
         &SettingsDialog::saveIntervalBetweenRewards
     );
+    connect(ui->eventsubEnabledCheckBox, &QCheckBox::stateChanged, this, &SettingsDialog::saveEventsubEnabled);
+    connect(
+        ui->pubsubHotStandbyEnabledCheckBox,
+        &QCheckBox::stateChanged,
+        this,
+        &SettingsDialog::savePubsubHotStandbyEnabled
+    );
+    connect(ui->caBundlePathEdit, &QLineEdit::editingFinished, this, &SettingsDialog::saveCaBundlePath);
     connect(
         ui->openRewardRedemptionQueueButton, &QPushButton::clicked, this, &SettingsDialog::openRewardRedemptionQueue
     );
@@ -150,6 +161,25 @@ void SettingsDialog::saveIntervalBetweenRewards(double interval) {
     plugin.getSettings().setIntervalBetweenRewardsSeconds(interval);
 }
 
+void SettingsDialog::saveEventsubEnabled(int checkState) {
+    plugin.setEventsubEnabled(checkState == Qt::Checked);
+}
+
+void SettingsDialog::savePubsubHotStandbyEnabled(int checkState) {
+    plugin.getSettings().setPubsubHotStandbyEnabled(checkState == Qt::Checked);
+}
+
+void SettingsDialog::saveCaBundlePath() {
+    std::string caBundlePath = ui->caBundlePathEdit->text().trimmed().toStdString();
+    std::optional<std::string> newCaBundlePath;
+    if (!caBundlePath.empty()) {
+        newCaBundlePath = caBundlePath;
+    }
+    if (newCaBundlePath != plugin.getSettings().getCaBundlePath()) {
+        plugin.setCaBundlePath(newCaBundlePath);
+    }
+}
+
 void SettingsDialog::openRewardRedemptionQueue() {
     rewardRedemptionQueueDialog->showAndActivate();
 }
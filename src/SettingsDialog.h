@@ -36,6 +36,9 @@ private slots:
     void setRewardPlaybackPaused(int checkState);
     void saveRewardRedemptionQueueEnabled(int checkState);
     void saveIntervalBetweenRewards(double interval);
+    void saveEventsubEnabled(int checkState);
+    void savePubsubHotStandbyEnabled(int checkState);
+    void saveCaBundlePath();
     void openRewardRedemptionQueue();
 
 private:
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "TlsContext.h"
+
+#include "Log.h"
+
+namespace ssl = boost::asio::ssl;
+
+TlsContext::TlsContext(Settings& settings) : settings(settings), context(createContext()) {}
+
+TlsContext::~TlsContext() = default;
+
+std::shared_ptr<ssl::context> TlsContext::get() const {
+    std::lock_guard guard(contextMutex);
+    return context;
+}
+
+void TlsContext::reload() {
+    std::shared_ptr<ssl::context> newContext = createContext();
+    std::lock_guard guard(contextMutex);
+    context = std::move(newContext);
+    sessionCache.clear();
+}
+
+void TlsContext::prepareHandshake(SSL* ssl, const std::string& host) {
+    if (!SSL_set_tlsext_host_name(ssl, host.c_str())) {
+        throw boost::system::system_error(
+            boost::system::error_code(static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()),
+            "Failed to set SNI Hostname"
+        );
+    }
+    sessionCache.setSession(ssl, host);
+}
+
+void TlsContext::onHandshakeCompleted(SSL* ssl) {
+    sessionCache.onHandshakeCompleted(ssl);
+}
+
+TlsSessionCache::Stats TlsContext::getSessionCacheStats() const {
+    return sessionCache.getStats();
+}
+
+std::shared_ptr<ssl::context> TlsContext::createContext() {
+    // Allow TLS 1.3 as well: its handshake is one round trip shorter, and its session tickets are resumable.
+    auto newContext = std::make_shared<ssl::context>(ssl::context::tls_client);
+    SSL_CTX_set_min_proto_version(newContext->native_handle(), TLS1_2_VERSION);
+    sessionCache.install(*newContext);
+
+    std::optional<std::string> caBundlePath = settings.getCaBundlePath();
+    if (caBundlePath) {
+        try {
+            newContext->load_verify_file(caBundlePath.value());
+            log(LOG_INFO, "Loaded CA certificates from {}", caBundlePath.value());
+            return newContext;
+        } catch (const std::exception& exception) {
+            log(LOG_ERROR, "Failed to load CA certificates from {}: {}", caBundlePath.value(), exception.what());
+        }
+    }
+    newContext->set_default_verify_paths();
+    return newContext;
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "BoostAsio.h"
+#include "Settings.h"
+#include "TlsSessionCache.h"
+
+/// The TLS client context shared by all the connections of the plugin.
+/// Loading the CA certificates is expensive, so it's done once at startup and then only upon reload(), which lets
+/// a new CA bundle take effect without restarting OBS.
+class TlsContext {
+public:
+    TlsContext(Settings& settings);
+    ~TlsContext();
+
+    /// Thread-safe. The returned context stays valid even if reload() is called concurrently.
+    std::shared_ptr<boost::asio::ssl::context> get() const;
+
+    /// Recreates the context, e.g. after the CA bundle path in the settings has changed.
+    /// The existing connections keep using the old context.
+    void reload();
+
+    /// Sets the SNI hostname and offers a cached session for resumption.
+    void prepareHandshake(SSL* ssl, const std::string& host);
+    void onHandshakeCompleted(SSL* ssl);
+    TlsSessionCache::Stats getSessionCacheStats() const;
+
+private:
+    std::shared_ptr<boost::asio::ssl::context> createContext();
+
+    Settings& settings;
+    TlsSessionCache sessionCache;
+    std::shared_ptr<boost::asio::ssl::context> context;
+    mutable std::mutex contextMutex;
+};
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "TlsSessionCache.h"
+
+#include "Log.h"
+
+// The index under which the cache pointer is stored in the SSL_CTX, so that onNewSession can find it.
+static int getCacheExDataIndex() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+TlsSessionCache::TlsSessionCache() : resumedHandshakes(0), fullHandshakes(0) {}
+
+TlsSessionCache::~TlsSessionCache() = default;
+
+void TlsSessionCache::install(boost::asio::ssl::context& context) {
+    SSL_CTX* ctx = context.native_handle();
+    SSL_CTX_set_ex_data(ctx, getCacheExDataIndex(), this);
+    // OpenSSL's internal cache is keyed by session ID which is only useful for servers, so store sessions ourselves.
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &TlsSessionCache::onNewSession);
+}
+
+void TlsSessionCache::setSession(SSL* ssl, const std::string& host) {
+    std::lock_guard guard(sessionsMutex);
+    auto it = sessions.find(host);
+    if (it == sessions.end()) {
+        return;
+    }
+    if (!SSL_SESSION_is_resumable(it->second.get())) {
+        sessions.erase(it);
+        return;
+    }
+    // SSL_set_session takes its own reference, so the cache can free the session at any moment.
+    SSL_set_session(ssl, it->second.get());
+}
+
+void TlsSessionCache::onHandshakeCompleted(SSL* ssl) {
+    if (SSL_session_reused(ssl)) {
+        resumedHandshakes++;
+    } else {
+        fullHandshakes++;
+    }
+    const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    log(
+        LOG_DEBUG,
+        "TLS handshake with {}: {}, {} resumed / {} full so far",
+        host ? host : "unknown host",
+        SSL_session_reused(ssl) ? "resumed" : "full",
+        resumedHandshakes.load(),
+        fullHandshakes.load()
+    );
+}
+
+TlsSessionCache::Stats TlsSessionCache::getStats() const {
+    return {resumedHandshakes.load(), fullHandshakes.load()};
+}
+
+void TlsSessionCache::clear() {
+    std::lock_guard guard(sessionsMutex);
+    sessions.clear();
+}
+
+void TlsSessionCache::SessionDeleter::operator()(SSL_SESSION* session) const {
+    SSL_SESSION_free(session);
+}
+
+int TlsSessionCache::onNewSession(SSL* ssl, SSL_SESSION* session) {
+    // Called both right after a TLS 1.2 handshake and whenever a TLS 1.3 server sends a new session ticket.
+    auto* cache = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), getCacheExDataIndex()));
+    const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (cache == nullptr || host == nullptr) {
+        return 0;
+    }
+    std::lock_guard guard(cache->sessionsMutex);
+    cache->sessions[host] = SessionPtr(session);
+    return 1;  // We've taken ownership of the session reference.
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "BoostAsio.h"
+
+/// Remembers the last TLS session (a TLS 1.3 ticket or a TLS 1.2 session ID) for every host,
+/// so that reconnecting to the host resumes the session instead of doing a full handshake.
+class TlsSessionCache {
+public:
+    TlsSessionCache();
+    ~TlsSessionCache();
+
+    /// Makes the connections created from the context save their sessions into this cache.
+    void install(boost::asio::ssl::context& context);
+
+    /// Offers the saved session for the host, if there's one. Call before the handshake.
+    void setSession(SSL* ssl, const std::string& host);
+
+    /// Updates the counters. Call after a successful handshake.
+    void onHandshakeCompleted(SSL* ssl);
+
+    struct Stats {
+        std::uint64_t resumedHandshakes;
+        std::uint64_t fullHandshakes;
+    };
+    Stats getStats() const;
+
+    void clear();
+
+private:
+    struct SessionDeleter {
+        void operator()(SSL_SESSION* session) const;
+    };
+    using SessionPtr = std::unique_ptr<SSL_SESSION, SessionDeleter>;
+
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+
+    std::map<std::string, SessionPtr> sessions;
+    std::mutex sessionsMutex;
+    std::atomic<std::uint64_t> resumedHandshakes;
+    std::atomic<std::uint64_t> fullHandshakes;
+};
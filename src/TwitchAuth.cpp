@@ -35,7 +35,7 @@ TwitchAuth::TwitchAuth(
     asio::io_context& ioContext
 )
     : settings(settings), clientId(clientId), scopes(scopes), authServerPort(authServerPort), httpClient(httpClient),
-      ioContext(ioContext), randomEngine(std::random_device()()) {}
+      ioContext(ioContext), requestScope(ioContext), randomEngine(std::random_device()()) {}
 
 TwitchAuth::~TwitchAuth() = default;
 
@@ -87,6 +87,20 @@ const std::string& TwitchAuth::getClientId() const {
     return clientId;
 }
 
+void TwitchAuth::addAuthorizationHeaders(HttpHeaderBuilder& headers) const {
+    std::lock_guard guard(userMutex);
+    if (!accessToken) {
+        throw UnauthenticatedException();
+    }
+    // The token is copied into the builder, as it may change once the lock is released.
+    headers.add("Authorization", "Bearer ", accessToken.value());
+    headers.add("Client-Id", clientId);
+}
+
+HttpClient::CancellationScope& TwitchAuth::getRequestScope() {
+    return requestScope;
+}
+
 static void openUrl(const std::string& url);
 
 void TwitchAuth::authenticate() {
@@ -109,6 +123,7 @@ void TwitchAuth::logOut() {
         userId = {};
         username = {};
     }
+    requestScope.cancel();
     settings.setTwitchAccessToken({});
     emit onUserChanged();
     emit onUsernameChanged({});
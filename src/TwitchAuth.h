@@ -16,6 +16,7 @@
 
 #include "BoostAsio.h"
 #include "HttpClient.h"
+#include "HttpHeaderBuilder.h"
 #include "Settings.h"
 
 /// A class for Twitch authentication using the Implicit grant flow.
@@ -42,6 +43,10 @@ public:
     std::string getUserIdOrThrow() const;
     std::optional<std::string> getUsername() const;
     const std::string& getClientId() const;
+    /// Adds the Authorization and Client-Id header fields. Throws UnauthenticatedException if there's no token.
+    void addAuthorizationHeaders(HttpHeaderBuilder& headers) const;
+    /// The requests made on behalf of the user. They're cancelled when the user logs out.
+    HttpClient::CancellationScope& getRequestScope();
 
     void authenticate();
     void authenticateWithToken(const std::string& token);
@@ -108,6 +113,7 @@ private:
     std::optional<std::string> userId;
     std::optional<std::string> username;
     mutable std::mutex userMutex;
+    HttpClient::CancellationScope requestScope;
 
     std::set<std::string> csrfStates;
     std::default_random_engine randomEngine;
@@ -7,6 +7,8 @@
 
 #include <QMetaType>
 #include <boost/url.hpp>
+#include <charconv>
+#include <cstdint>
 #include <iomanip>
 #include <ranges>
 #include <set>
@@ -15,24 +17,65 @@
 #include <variant>
 
 #include "HttpClient.h"
+#include "HttpEndpoint.h"
 #include "Log.h"
 
 namespace asio = boost::asio;
 namespace http = boost::beast::http;
 namespace json = boost::json;
 
+// https://dev.twitch.tv/docs/api/reference/#create-custom-rewards
+static constexpr HttpEndpoint CREATE_REWARD_ENDPOINT(
+    "api.twitch.tv",
+    "/helix/channel_points/custom_rewards",
+    http::verb::post,
+    {http::status::ok, http::status::forbidden}
+);
+// https://dev.twitch.tv/docs/api/reference/#update-custom-reward
+static constexpr HttpEndpoint UPDATE_REWARD_ENDPOINT(
+    "api.twitch.tv", "/helix/channel_points/custom_rewards", http::verb::patch, {http::status::ok}
+);
+// https://dev.twitch.tv/docs/api/reference/#get-custom-reward
+static constexpr HttpEndpoint GET_REWARDS_ENDPOINT(
+    "api.twitch.tv",
+    "/helix/channel_points/custom_rewards",
+    http::verb::get,
+    {http::status::ok, http::status::forbidden}
+);
+// https://dev.twitch.tv/docs/api/reference/#delete-custom-reward
+static constexpr HttpEndpoint DELETE_REWARD_ENDPOINT(
+    "api.twitch.tv", "/helix/channel_points/custom_rewards", http::verb::delete_, {http::status::no_content}
+);
+// https://dev.twitch.tv/docs/api/reference/#update-redemption-status
+static constexpr HttpEndpoint UPDATE_REDEMPTION_STATUS_ENDPOINT(
+    "api.twitch.tv", "/helix/channel_points/custom_rewards/redemptions", http::verb::patch, {http::status::ok}
+);
+// https://dev.twitch.tv/docs/api/reference/#get-custom-reward-redemption
+static constexpr HttpEndpoint GET_REDEMPTIONS_ENDPOINT(
+    "api.twitch.tv", "/helix/channel_points/custom_rewards/redemptions", http::verb::get, {http::status::ok}
+);
+// The maximum page size of GET_REDEMPTIONS_ENDPOINT.
+static const char* const REDEMPTIONS_PAGE_SIZE = "50";
+// Reward images are at most 112x112 pixels, so anything bigger than this isn't an image that can be shown.
+static const std::uint64_t MAX_IMAGE_SIZE = 1024 * 1024;
+
 TwitchRewardsApi::TwitchRewardsApi(
     TwitchAuth& twitchAuth,
     HttpClient& httpClient,
     Settings& settings,
     asio::io_context& ioContext
 )
-    : twitchAuth(twitchAuth), httpClient(httpClient), settings(settings), ioContext(ioContext) {
+    : twitchAuth(twitchAuth), httpClient(httpClient), settings(settings), ioContext(ioContext),
+      helixScheduler(ioContext) {
     connect(&twitchAuth, &TwitchAuth::onUserChanged, this, &TwitchRewardsApi::reloadRewards);
 }
 
 TwitchRewardsApi::~TwitchRewardsApi() = default;
 
+Reward tag_invoke(const json::value_to_tag<Reward>&, const json::value& reward) {
+    return TwitchRewardsApi::parseReward(reward, false);
+}
+
 void TwitchRewardsApi::createReward(const RewardData& rewardData, QObject* receiver, const char* member) {
     asio::co_spawn(
         ioContext, asyncCreateReward(rewardData, *(new QObjectCallback(this, receiver, member))), asio::detached
@@ -65,23 +108,57 @@ void TwitchRewardsApi::updateRedemptionStatus(const RewardRedemption& rewardRede
     asio::co_spawn(ioContext, asyncUpdateRedemptionStatus(rewardRedemption, status), asio::detached);
 }
 
-Reward TwitchRewardsApi::parsePubsubReward(const json::value& reward) {
-    // The format of the reward for PubSub events differs slightly from the Helix one, hence we need another function.
+Reward TwitchRewardsApi::parseEventsubReward(const json::value& reward) {
+    // EventSub events only contain the id, the title, the prompt and the cost of the reward, the rest is defaulted.
     return Reward{
         value_to<std::string>(reward.at("id")),
         value_to<std::string>(reward.at("title")),
         value_to<std::string>(reward.at("prompt")),
         value_to<std::int32_t>(reward.at("cost")),
-        getImageUrl(reward),
-        reward.at("is_enabled").as_bool(),
-        value_to<std::string>(reward.at("background_color")),
-        getOptionalSetting(reward.at("max_per_stream"), "max_per_stream"),
-        getOptionalSetting(reward.at("max_per_user_per_stream"), "max_per_user_per_stream"),
-        getOptionalSetting(reward.at("global_cooldown"), "global_cooldown_seconds"),
+        boost::urls::url(),
+        true,
+        Color(),
+        {},
+        {},
+        {},
         false,
     };
 }
 
+std::chrono::system_clock::time_point TwitchRewardsApi::parseTimestamp(std::string_view timestamp) {
+    // The time zone is always Z, so it's ignored. The fractional seconds are truncated to microseconds.
+    int values[6];
+    const char* const separators = "--T::";
+    const char* position = timestamp.data();
+    const char* end = timestamp.data() + timestamp.size();
+    for (int i = 0; i < 6; i++) {
+        auto [next, error] = std::from_chars(position, end, values[i]);
+        if (error != std::errc() || (i < 5 && (next == end || *next != separators[i]))) {
+            throw InvalidTimestampException();
+        }
+        position = i < 5 ? next + 1 : next;
+    }
+    std::chrono::microseconds fraction(0);
+    if (position != end && *position == '.') {
+        auto scale = std::chrono::microseconds(std::chrono::seconds(1)).count();
+        for (position++; position != end && *position >= '0' && *position <= '9'; position++) {
+            scale /= 10;
+            fraction += std::chrono::microseconds((*position - '0') * scale);
+        }
+    }
+
+    std::chrono::year_month_day date{
+        std::chrono::year(values[0]),
+        std::chrono::month(static_cast<unsigned>(values[1])),
+        std::chrono::day(static_cast<unsigned>(values[2])),
+    };
+    if (!date.ok()) {
+        throw InvalidTimestampException();
+    }
+    return std::chrono::sys_days(date) + std::chrono::hours(values[3]) + std::chrono::minutes(values[4]) +
+           std::chrono::seconds(values[5]) + fraction;
+}
+
 const char* TwitchRewardsApi::EmptyRewardTitleException::what() const noexcept {
     return "EmptyRewardTitleException";
 }
@@ -106,6 +183,10 @@ const char* TwitchRewardsApi::RewardNotUpdatedException::what() const noexcept {
     return "RewardNotUpdatedException";
 }
 
+const char* TwitchRewardsApi::InvalidTimestampException::what() const noexcept {
+    return "InvalidTimestampException";
+}
+
 TwitchRewardsApi::UnexpectedHttpStatusException::UnexpectedHttpStatusException(const boost::json::value& response)
     : message(serialize(response)) {}
 
@@ -165,7 +246,7 @@ asio::awaitable<void> TwitchRewardsApi::asyncDownloadImage(boost::urls::url url,
     }
 }
 
-boost::asio::awaitable<void> TwitchRewardsApi::asyncUpdateRedemptionStatus(
+boost::asio::awaitable<bool> TwitchRewardsApi::asyncUpdateRedemptionStatus(
     RewardRedemption rewardRedemption,
     RedemptionStatus status
 ) {
@@ -183,44 +264,106 @@ boost::asio::awaitable<void> TwitchRewardsApi::asyncUpdateRedemptionStatus(
             {"reward_id", rewardRedemption.reward.id},
         };
         json::value requestBody{{"status", statusString}};
-        HttpClient::Response response = co_await httpClient.request(
-            "api.twitch.tv",
-            "/helix/channel_points/custom_rewards/redemptions",
-            twitchAuth,
-            requestParams,
-            http::verb::patch,
-            requestBody
+        HttpClient::Response response = co_await helixScheduler.run<HttpClient::Response>(
+            HelixRequestScheduler::Priority::REDEMPTION_STATUS,
+            [&] {
+                return httpClient.request(UPDATE_REDEMPTION_STATUS_ENDPOINT, twitchAuth, requestParams, requestBody);
+            }
         );
-        if (response.status != http::status::ok) {
+        if (!UPDATE_REDEMPTION_STATUS_ENDPOINT.isExpectedStatus(response.status)) {
             throw UnexpectedHttpStatusException(response.json);
         }
         log(LOG_DEBUG, "Successfully updated redemption status to {}", statusString);
+        co_return true;
     } catch (const std::exception& exception) {
         log(LOG_ERROR, "Exception in asyncUpdateRedemptionStatus: {}", exception.what());
     }
+    co_return false;
+}
+
+asio::awaitable<std::vector<RewardRedemption>> TwitchRewardsApi::asyncGetUnfulfilledRedemptions(
+    const Reward& reward,
+    std::chrono::system_clock::time_point since
+) {
+    std::string userId = twitchAuth.getUserIdOrThrow();
+    std::vector<RewardRedemption> redemptions;
+    std::string cursor;
+    while (true) {
+        std::initializer_list<boost::urls::param_view> firstPageParams{
+            {"broadcaster_id", userId},
+            {"reward_id", reward.id},
+            {"status", "UNFULFILLED"},
+            {"sort", "NEWEST"},
+            {"first", REDEMPTIONS_PAGE_SIZE},
+        };
+        std::initializer_list<boost::urls::param_view> nextPageParams{
+            {"broadcaster_id", userId},
+            {"reward_id", reward.id},
+            {"status", "UNFULFILLED"},
+            {"sort", "NEWEST"},
+            {"first", REDEMPTIONS_PAGE_SIZE},
+            {"after", cursor},
+        };
+        HttpClient::Response response = co_await helixScheduler.run<HttpClient::Response>(
+            HelixRequestScheduler::Priority::REDEMPTION_RECONCILE,
+            [&] {
+                return httpClient.request(
+                    GET_REDEMPTIONS_ENDPOINT, twitchAuth, cursor.empty() ? firstPageParams : nextPageParams
+                );
+            }
+        );
+        if (!GET_REDEMPTIONS_ENDPOINT.isExpectedStatus(response.status)) {
+            throw UnexpectedHttpStatusException(response.json);
+        }
+
+        for (const json::value& redemption : response.json.at("data").as_array()) {
+            auto redeemedAt = parseTimestamp(redemption.at("redeemed_at").as_string());
+            if (redeemedAt < since) {
+                // The redemptions are sorted from the newest, so the rest are even older.
+                co_return redemptions;
+            }
+            redemptions.push_back(RewardRedemption{
+                reward,
+                value_to<std::string>(redemption.at("id")),
+                RedemptionTimestamps{
+                    redeemedAt, std::chrono::steady_clock::now(), {}, {}, RedemptionSource::RECONCILED
+                },
+            });
+        }
+
+        const json::value* nextCursor = response.json.at("pagination").as_object().if_contains("cursor");
+        if (nextCursor == nullptr || !nextCursor->is_string()) {
+            co_return redemptions;
+        }
+        cursor = value_to<std::string>(*nextCursor);
+    }
 }
 
-// https://dev.twitch.tv/docs/api/reference/#create-custom-rewards
 asio::awaitable<Reward> TwitchRewardsApi::asyncCreateReward(const RewardData& rewardData) {
     std::string userId = twitchAuth.getUserIdOrThrow();
     std::initializer_list<boost::urls::param_view> requestParams{{"broadcaster_id", userId}};
-    HttpClient::Response response = co_await httpClient.request(
-        "api.twitch.tv",
-        "/helix/channel_points/custom_rewards",
-        twitchAuth,
-        requestParams,
-        http::verb::post,
-        rewardDataToJson(rewardData)
-    );
+    json::value requestBody = rewardDataToJson(rewardData);
+    HttpClient::TypedResponse<HelixData<Reward>> response =
+        co_await helixScheduler.run<HttpClient::TypedResponse<HelixData<Reward>>>(
+            HelixRequestScheduler::Priority::REWARD_CRUD,
+            [&] {
+                return httpClient.request<HelixData<Reward>>(
+                    CREATE_REWARD_ENDPOINT, twitchAuth, requestParams, requestBody
+                );
+            }
+        );
 
     checkForSameRewardTitleException(response.json);
-    switch (response.status) {
-    case http::status::ok: break;
-    case http::status::forbidden: throw NotAffiliateException();
-    default: throw UnexpectedHttpStatusException(response.json);
+    if (!CREATE_REWARD_ENDPOINT.isExpectedStatus(response.status)) {
+        throw UnexpectedHttpStatusException(response.json);
+    }
+    if (response.status == http::status::forbidden) {
+        throw NotAffiliateException();
     }
 
-    co_return parseReward(response.json.at("data").at(0), true);
+    Reward reward = response.value.value().data.at(0);
+    reward.canManage = true;
+    co_return reward;
 }
 
 boost::asio::awaitable<Reward> TwitchRewardsApi::asyncUpdateReward(const Reward& reward) {
@@ -230,21 +373,24 @@ boost::asio::awaitable<Reward> TwitchRewardsApi::asyncUpdateReward(const Reward&
 
     std::string userId = twitchAuth.getUserIdOrThrow();
     std::initializer_list<boost::urls::param_view> requestParams{{"broadcaster_id", userId}, {"id", reward.id}};
-    HttpClient::Response response = co_await httpClient.request(
-        "api.twitch.tv",
-        "/helix/channel_points/custom_rewards",
-        twitchAuth,
-        requestParams,
-        http::verb::patch,
-        rewardDataToJson(reward)
-    );
+    json::value requestBody = rewardDataToJson(reward);
+    HttpClient::TypedResponse<HelixData<Reward>> response =
+        co_await helixScheduler.run<HttpClient::TypedResponse<HelixData<Reward>>>(
+            HelixRequestScheduler::Priority::REWARD_CRUD,
+            [&] {
+                return httpClient.request<HelixData<Reward>>(
+                    UPDATE_REWARD_ENDPOINT, twitchAuth, requestParams, requestBody
+                );
+            }
+        );
 
     checkForSameRewardTitleException(response.json);
-    if (response.status != http::status::ok) {
+    if (!UPDATE_REWARD_ENDPOINT.isExpectedStatus(response.status)) {
         throw UnexpectedHttpStatusException(response.json);
     }
 
-    Reward updatedReward = parseReward(response.json.at("data").at(0), true);
+    Reward updatedReward = response.value.value().data.at(0);
+    updatedReward.canManage = true;
     if (updatedReward != reward) {
         throw RewardNotUpdatedException();
     }
@@ -293,42 +439,43 @@ void TwitchRewardsApi::checkForSameRewardTitleException(const boost::json::value
     }
 }
 
-// https://dev.twitch.tv/docs/api/reference/#get-custom-reward
 asio::awaitable<std::vector<Reward>> TwitchRewardsApi::asyncGetRewards() {
-    json::value manageableRewardsJson = co_await asyncGetRewardsRequest(true);
-    auto manageableRewardIdsView =
-        manageableRewardsJson.at("data").as_array() | std::views::transform([](const auto& reward) {
-            return value_to<std::string>(reward.at("id"));
-        });
+    std::vector<Reward> manageableRewards = co_await asyncGetRewardsRequest(true);
+    auto manageableRewardIdsView = manageableRewards | std::views::transform([](const Reward& reward) {
+                                       return reward.id;
+                                   });
     std::set<std::string> manageableRewardIds(manageableRewardIdsView.begin(), manageableRewardIdsView.end());
 
-    auto allRewardsJson = co_await asyncGetRewardsRequest(false);
-    auto rewards =
-        allRewardsJson.at("data").as_array() | std::views::transform([&manageableRewardIds](const auto& reward) {
-            std::string id = value_to<std::string>(reward.at("id"));
-            bool isManageable = manageableRewardIds.contains(id);
-            return parseReward(reward, isManageable);
-        });
-    co_return std::vector<Reward>(rewards.begin(), rewards.end());
+    std::vector<Reward> rewards = co_await asyncGetRewardsRequest(false);
+    for (Reward& reward : rewards) {
+        reward.canManage = manageableRewardIds.contains(reward.id);
+    }
+    co_return rewards;
 }
 
-asio::awaitable<json::value> TwitchRewardsApi::asyncGetRewardsRequest(bool onlyManageableRewards) {
+asio::awaitable<std::vector<Reward>> TwitchRewardsApi::asyncGetRewardsRequest(bool onlyManageableRewards) {
     std::string userId = twitchAuth.getUserIdOrThrow();
     std::string onlyManageableRewardsString = fmt::format("{}", onlyManageableRewards);
     std::initializer_list<boost::urls::param_view> requestParams{
         {"broadcaster_id", userId},
         {"only_manageable_rewards", onlyManageableRewardsString},
     };
-    HttpClient::Response response =
-        co_await httpClient.request("api.twitch.tv", "/helix/channel_points/custom_rewards", twitchAuth, requestParams);
+    HttpClient::TypedResponse<HelixData<Reward>> response =
+        co_await helixScheduler.run<HttpClient::TypedResponse<HelixData<Reward>>>(
+            HelixRequestScheduler::Priority::REWARD_RELOAD,
+            [&] {
+                return httpClient.request<HelixData<Reward>>(GET_REWARDS_ENDPOINT, twitchAuth, requestParams);
+            }
+        );
 
-    switch (response.status) {
-    case http::status::ok: break;
-    case http::status::forbidden: throw NotAffiliateException();
-    default: throw UnexpectedHttpStatusException(response.json);
+    if (!GET_REWARDS_ENDPOINT.isExpectedStatus(response.status)) {
+        throw UnexpectedHttpStatusException(response.json);
+    }
+    if (response.status == http::status::forbidden) {
+        throw NotAffiliateException();
     }
 
-    co_return response.json;
+    co_return std::move(response.value.value().data);
 }
 
 Reward TwitchRewardsApi::parseReward(const json::value& reward, bool isManageable) {
@@ -371,11 +518,14 @@ asio::awaitable<void> TwitchRewardsApi::asyncDeleteReward(const Reward& reward)
 
     std::string userId = twitchAuth.getUserIdOrThrow();
     std::initializer_list<boost::urls::param_view> requestParams{{"broadcaster_id", userId}, {"id", reward.id}};
-    HttpClient::Response response = co_await httpClient.request(
-        "api.twitch.tv", "/helix/channel_points/custom_rewards", twitchAuth, requestParams, http::verb::delete_
+    HttpClient::Response response = co_await helixScheduler.run<HttpClient::Response>(
+        HelixRequestScheduler::Priority::REWARD_CRUD,
+        [&] {
+            return httpClient.request(DELETE_REWARD_ENDPOINT, twitchAuth, requestParams);
+        }
     );
 
-    if (response.status != http::status::no_content) {
+    if (!DELETE_REWARD_ENDPOINT.isExpectedStatus(response.status)) {
         throw UnexpectedHttpStatusException(response.json);
     }
 
@@ -383,5 +533,6 @@ asio::awaitable<void> TwitchRewardsApi::asyncDeleteReward(const Reward& reward)
 }
 
 asio::awaitable<std::string> TwitchRewardsApi::asyncDownloadImage(const boost::urls::url& url) {
-    co_return co_await httpClient.downloadFile(url.host(), url.path());
+    HelixRequestScheduler::Slot slot = co_await helixScheduler.acquire(HelixRequestScheduler::Priority::IMAGE);
+    co_return co_await httpClient.downloadFile(url.host(), url.path(), MAX_IMAGE_SIZE);
 }
@@ -4,21 +4,38 @@
 #pragma once
 
 #include <boost/json.hpp>
+#include <chrono>
 #include <exception>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "BoostAsio.h"
+#include "HelixRequestScheduler.h"
 #include "HttpClient.h"
 #include "QObjectCallback.h"
 #include "Reward.h"
 #include "TwitchAuth.h"
 
+/// Helix responses wrap the returned objects into a "data" array.
+template <typename T>
+struct HelixData {
+    std::vector<T> data;
+};
+
+template <typename T>
+HelixData<T> tag_invoke(const boost::json::value_to_tag<HelixData<T>>&, const boost::json::value& response) {
+    return {boost::json::value_to<std::vector<T>>(response.at("data"))};
+}
+
+/// Converts a reward in the Helix format. canManage is always false, as the reward JSON doesn't contain it.
+Reward tag_invoke(const boost::json::value_to_tag<Reward>&, const boost::json::value& reward);
+
 class TwitchRewardsApi : public QObject {
     Q_OBJECT
 
@@ -51,8 +68,23 @@ public:
         FULFILLED,
     };
     void updateRedemptionStatus(const RewardRedemption& rewardRedemption, RedemptionStatus status);
+    /// Returns true once Twitch has acknowledged the update, false if it has failed. Doesn't throw.
+    boost::asio::awaitable<bool> asyncUpdateRedemptionStatus(
+        RewardRedemption rewardRedemption,
+        RedemptionStatus status
+    );
+
+    /// Loads the UNFULFILLED redemptions of a manageable reward that have been redeemed since the given time,
+    /// newest first. Only as many pages are loaded as needed to reach that time. The redemptions have redeemedAt set
+    /// and RECONCILED as the source.
+    boost::asio::awaitable<std::vector<RewardRedemption>> asyncGetUnfulfilledRedemptions(
+        const Reward& reward,
+        std::chrono::system_clock::time_point since
+    );
 
-    static Reward parsePubsubReward(const boost::json::value& reward);
+    static Reward parseEventsubReward(const boost::json::value& reward);
+    /// Parses the RFC 3339 timestamps of Helix and EventSub, such as 2023-07-01T18:37:32.123456Z.
+    static std::chrono::system_clock::time_point parseTimestamp(std::string_view timestamp);
 
     class EmptyRewardTitleException : public std::exception {
     public:
@@ -83,6 +115,11 @@ public:
         const char* what() const noexcept override;
     };
 
+    class InvalidTimestampException : public std::exception {
+    public:
+        const char* what() const noexcept override;
+    };
+
     class UnexpectedHttpStatusException : public std::exception {
     public:
         UnexpectedHttpStatusException(const boost::json::value& response);
@@ -101,10 +138,6 @@ private:
     boost::asio::awaitable<void> asyncReloadRewards();
     boost::asio::awaitable<void> asyncDeleteReward(Reward reward, QObjectCallback& callback);
     boost::asio::awaitable<void> asyncDownloadImage(boost::urls::url url, QObjectCallback& callback);
-    boost::asio::awaitable<void> asyncUpdateRedemptionStatus(
-        RewardRedemption rewardRedemption,
-        RedemptionStatus status
-    );
 
     boost::asio::awaitable<Reward> asyncCreateReward(const RewardData& rewardData);
     boost::asio::awaitable<Reward> asyncUpdateReward(const Reward& reward);
@@ -112,8 +145,9 @@ private:
     void checkForSameRewardTitleException(const boost::json::value& response);
 
     boost::asio::awaitable<std::vector<Reward>> asyncGetRewards();
-    boost::asio::awaitable<boost::json::value> asyncGetRewardsRequest(bool onlyManageableRewards);
+    boost::asio::awaitable<std::vector<Reward>> asyncGetRewardsRequest(bool onlyManageableRewards);
     static Reward parseReward(const boost::json::value& reward, bool isManageable);
+    friend Reward tag_invoke(const boost::json::value_to_tag<Reward>&, const boost::json::value& reward);
     static boost::urls::url getImageUrl(const boost::json::value& reward);
     static std::optional<std::int64_t> getOptionalSetting(const boost::json::value& setting, const std::string& key);
 
@@ -124,4 +158,5 @@ private:
     HttpClient& httpClient;
     Settings& settings;
     boost::asio::io_context& ioContext;
+    HelixRequestScheduler helixScheduler;
 };
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "WebsocketCompression.h"
+
+#include <algorithm>
+
+#include "Log.h"
+
+WebsocketCompression::WebsocketCompression(int windowBits, int memoryLevel)
+    : compressedBytes(0), uncompressedBytes(0) {
+    // zlib doesn't support raw deflate with a window of 8 bits, which permessage-deflate would otherwise allow.
+    windowBits = std::clamp(windowBits, 9, 15);
+    options.client_enable = true;
+    options.client_max_window_bits = windowBits;
+    options.server_max_window_bits = windowBits;
+    options.memLevel = std::clamp(memoryLevel, 1, 9);
+}
+
+WebsocketCompression::~WebsocketCompression() = default;
+
+WebsocketCompression::Stats WebsocketCompression::getStats() const {
+    return Stats{compressedBytes, uncompressedBytes};
+}
+
+void WebsocketCompression::logStats() const {
+    Stats stats = getStats();
+    if (stats.uncompressedBytes == 0) {
+        return;
+    }
+    log(
+        LOG_INFO,
+        "WebSocket traffic: received {} bytes for {} bytes of messages ({:.1f}%)",
+        stats.compressedBytes,
+        stats.uncompressedBytes,
+        100.0 * static_cast<double>(stats.compressedBytes) / static_cast<double>(stats.uncompressedBytes)
+    );
+}
+
+WebsocketCompression::Counter::Counter(WebsocketCompression& compression, SSL* ssl)
+    : compression(&compression), ssl(ssl), tlsBytesRead(BIO_number_read(SSL_get_rbio(ssl))) {}
+
+void WebsocketCompression::Counter::recordMessage(std::size_t messageSize) {
+    std::uint64_t newTlsBytesRead = BIO_number_read(SSL_get_rbio(ssl));
+    compression->compressedBytes += newTlsBytesRead - tlsBytesRead;
+    compression->uncompressedBytes += messageSize;
+    tlsBytesRead = newTlsBytesRead;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "BoostAsio.h"
+
+/// permessage-deflate (RFC 7692) for the PubSub and EventSub WebSockets: the options offered in the handshake
+/// and the counters of the received bytes before and after decompression, to see how much bandwidth it saves.
+class WebsocketCompression {
+public:
+    /// The window bits apply to both directions and are clamped to 9..15, the memory level is clamped to 1..9.
+    WebsocketCompression(int windowBits, int memoryLevel);
+    ~WebsocketCompression();
+
+    /// Offers permessage-deflate in the handshake. Call before the WebSocket handshake.
+    template <typename NextLayer, bool deflateSupported>
+    void enable(boost::beast::websocket::stream<NextLayer, deflateSupported>& ws) const {
+        ws.set_option(options);
+    }
+
+    struct Stats {
+        /// The bytes received by the TLS layer, including the WebSocket framing and the TLS overhead.
+        std::uint64_t compressedBytes = 0;
+        /// The sizes of the received messages after decompression.
+        std::uint64_t uncompressedBytes = 0;
+    };
+    Stats getStats() const;
+    void logStats() const;
+
+    /// Counts the traffic of one connection. Create it after the handshake, so that the handshake isn't counted.
+    class Counter {
+    public:
+        Counter(WebsocketCompression& compression, SSL* ssl);
+
+        /// Call after a message has been read.
+        void recordMessage(std::size_t messageSize);
+
+    private:
+        WebsocketCompression* compression;
+        SSL* ssl;
+        std::uint64_t tlsBytesRead;
+    };
+
+private:
+    boost::beast::websocket::permessage_deflate options;
+    std::atomic<std::uint64_t> compressedBytes;
+    std::atomic<std::uint64_t> uncompressedBytes;
+};
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#include "WebsocketKeepalive.h"
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+// The first keepalive probe is sent after TCP_KEEPALIVE_IDLE_SECONDS of silence, then every
+// TCP_KEEPALIVE_INTERVAL_SECONDS, and the connection is dropped after TCP_KEEPALIVE_PROBE_COUNT unanswered probes.
+static const int TCP_KEEPALIVE_IDLE_SECONDS = 5;
+static const int TCP_KEEPALIVE_INTERVAL_SECONDS = 2;
+static const int TCP_KEEPALIVE_PROBE_COUNT = 3;
+// How long the sent data may stay unacknowledged before the connection is dropped.
+static const int TCP_USER_TIMEOUT_MILLISECONDS = 10000;
+
+template <int level, int name>
+static void setIntegerOption(tcp::socket& socket, int value) {
+    boost::system::error_code ec;
+    socket.set_option(asio::detail::socket_option::integer<level, name>(value), ec);
+    // The WebSocket pings still detect dead connections if the option isn't supported.
+}
+
+void WebsocketKeepalive::enableTcpKeepalive(tcp::socket& socket) {
+    boost::system::error_code ec;
+    socket.set_option(asio::socket_base::keep_alive(true), ec);
+
+#if defined(TCP_KEEPIDLE)
+    setIntegerOption<IPPROTO_TCP, TCP_KEEPIDLE>(socket, TCP_KEEPALIVE_IDLE_SECONDS);
+#elif defined(TCP_KEEPALIVE)
+    // macOS calls TCP_KEEPIDLE this way.
+    setIntegerOption<IPPROTO_TCP, TCP_KEEPALIVE>(socket, TCP_KEEPALIVE_IDLE_SECONDS);
+#endif
+#ifdef TCP_KEEPINTVL
+    setIntegerOption<IPPROTO_TCP, TCP_KEEPINTVL>(socket, TCP_KEEPALIVE_INTERVAL_SECONDS);
+#endif
+#ifdef TCP_KEEPCNT
+    setIntegerOption<IPPROTO_TCP, TCP_KEEPCNT>(socket, TCP_KEEPALIVE_PROBE_COUNT);
+#endif
+
+#if defined(TCP_USER_TIMEOUT)
+    setIntegerOption<IPPROTO_TCP, TCP_USER_TIMEOUT>(socket, TCP_USER_TIMEOUT_MILLISECONDS);
+#elif defined(TCP_RXT_CONNDROPTIME)
+    // The macOS equivalent, in seconds.
+    setIntegerOption<IPPROTO_TCP, TCP_RXT_CONNDROPTIME>(socket, TCP_USER_TIMEOUT_MILLISECONDS / 1000);
+#elif defined(TCP_MAXRT)
+    // The Windows equivalent, in seconds.
+    setIntegerOption<IPPROTO_TCP, TCP_MAXRT>(socket, TCP_USER_TIMEOUT_MILLISECONDS / 1000);
+#endif
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright (c) 2023, Lev Leontev
+
+#pragma once
+
+#include <chrono>
+
+#include "BoostAsio.h"
+
+/// Detects dead WebSocket connections within seconds. A half-open connection otherwise looks alive until
+/// an application-level ping goes unanswered, and the events sent in the meantime are lost.
+///
+/// Beast sends a WebSocket ping control frame after IDLE_TIMEOUT / 2 without any incoming data, and fails the
+/// pending read if nothing arrives within IDLE_TIMEOUT. TCP keepalive and TCP_USER_TIMEOUT make the OS drop
+/// the connection as well when the peer stops acknowledging, where the platform supports them.
+class WebsocketKeepalive {
+public:
+    static constexpr std::chrono::seconds HANDSHAKE_TIMEOUT{10};
+    static constexpr std::chrono::seconds IDLE_TIMEOUT{6};
+
+    /// Call after the TCP connection has been established and before the WebSocket handshake.
+    template <typename NextLayer, bool deflateSupported>
+    static void enable(boost::beast::websocket::stream<NextLayer, deflateSupported>& ws) {
+        enableTcpKeepalive(boost::beast::get_lowest_layer(ws));
+        ws.set_option(boost::beast::websocket::stream_base::timeout{HANDSHAKE_TIMEOUT, IDLE_TIMEOUT, true});
+    }
+
+    /// Best effort: the options that the platform doesn't support are skipped.
+    static void enableTcpKeepalive(boost::asio::ip::tcp::socket& socket);
+};